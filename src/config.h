@@ -14,4 +14,39 @@
 ////
 #define TAB_WIDTH 8
 
+// number of seconds a status message stays visible
+#define STATUS_MSG_TIMEOUT 5
+
+// minimum size of the gap allocated when a row grows
+#define ROW_GAP_MIN 16
+
+// distance in bytes between the column checkpoints of a long row
+#define ROW_CHECKPOINT 256
+
+// rows longer than this many bytes only render the columns on the screen
+#define ROW_RENDER_MAX 4096
+
+// number of rows allocated at once
+#define ROW_SLAB_ROWS 1024
+
+// flush saved files to disk before replacing the original
+#define SAVE_FSYNC 1
+
+// largest number of threads searching the document
+#define FIND_THREADS 8
+
+// render buffers are kept for this many screens worth of rows
+#define RENDER_KEEP_SCREENS 3
+
+// largest number of leaves (chunks of 512 rows) holding rows materialized
+// from the file, the rest is read from the file again when needed
+#define ROW_CACHE_LEAVES 64
+
+// size of the window frames are composed for when replaying a script
+#define REPLAY_ROWS 24
+#define REPLAY_COLS 80
+
+// largest amount of memory the undo history may take up
+#define UNDO_MEMORY (64 << 20)
+
 #endif // __CONFIG_H_
@@ -0,0 +1,815 @@
+/**
+ * @file:		src/document.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the document engine. Rows are kept
+ * 				in fixed-size chunks stored in the leaves of a balanced
+ * 				tree, so inserting or removing a row costs O(log n).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "document.h"
+#include "roku.h"
+
+// last leaf that was looked up and the index of its first row
+static document_node_t *cache_leaf = NULL;
+static int cache_first = 0;
+
+// leaves holding materialized rows, most recently used first
+static document_node_t *lru_head = NULL;
+static document_node_t *lru_tail = NULL;
+static int lru_count = 0;
+static int lru_hold = 0;
+
+// searches read the leaves while the main thread materializes rows,
+// so the rows and their arrays are stored with release semantics,
+// to be seen whole by document_leaf_row()
+#define DOCUMENT_PUBLISH(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+/**
+ * @brief	This routine allocates an empty tree node.
+ */
+static document_node_t *document_new_node(int is_leaf)
+{
+	document_node_t *node = malloc(sizeof(document_node_t));
+	node->parent = NULL;
+	node->prev = NULL;
+	node->next = NULL;
+	node->is_leaf = is_leaf;
+	node->count = 0;
+	node->rows = 0;
+	node->bytes = 0;
+	node->children = NULL;
+	node->offsets = NULL;
+	node->sizes = NULL;
+	node->materialized = NULL;
+	node->states = NULL;
+	node->lru_prev = NULL;
+	node->lru_next = NULL;
+	node->cached = 0;
+
+	if (is_leaf) {
+		node->offsets = malloc(sizeof(size_t) * DOCUMENT_LEAF_ROWS);
+		node->sizes = malloc(sizeof(int) * DOCUMENT_LEAF_ROWS);
+		node->states = calloc(DOCUMENT_LEAF_ROWS, 1);
+	} else {
+		node->children = malloc(sizeof(document_node_t *) * DOCUMENT_FANOUT);
+	}
+
+	return node;
+}
+
+/**
+ * @brief	This routine takes a leaf off the list of leaves
+ * 			holding materialized rows.
+ */
+static void document_lru_unlink(document_node_t *leaf)
+{
+	if (leaf->lru_prev) {
+		leaf->lru_prev->lru_next = leaf->lru_next;
+	} else {
+		lru_head = leaf->lru_next;
+	}
+	if (leaf->lru_next) {
+		leaf->lru_next->lru_prev = leaf->lru_prev;
+	} else {
+		lru_tail = leaf->lru_prev;
+	}
+
+	leaf->lru_prev = NULL;
+	leaf->lru_next = NULL;
+	leaf->cached = 0;
+	lru_count--;
+}
+
+/**
+ * @brief	This routine frees a tree node (but not its children).
+ */
+static void document_free_node(document_node_t *node)
+{
+	free(node->offsets);
+	free(node->sizes);
+	free(node->materialized);
+	free(node->states);
+	free(node->children);
+	free(node);
+}
+
+/**
+ * @brief	This routine adds the deltas to the row and byte counts
+ * 			of a node and all of its ancestors.
+ */
+static void document_adjust(document_node_t *node, int rows, long bytes)
+{
+	for (; node; node = node->parent) {
+		node->rows += rows;
+		node->bytes += bytes;
+	}
+}
+
+/**
+ * @brief	This routine returns the position of a node
+ * 			in its parent's child array.
+ */
+static int document_child_index(document_node_t *node)
+{
+	document_node_t *parent = node->parent;
+	int i = 0;
+
+	while (parent->children[i] != node) {
+		i++;
+	}
+
+	return i;
+}
+
+/**
+ * @brief	This routine recomputes the row and byte counts
+ * 			of an inner node from its children.
+ */
+static void document_sum_rows(document_node_t *node)
+{
+	node->rows = 0;
+	node->bytes = 0;
+	for (int i = 0; i < node->count; i++) {
+		node->rows += node->children[i]->rows;
+		node->bytes += node->children[i]->bytes;
+	}
+}
+
+/**
+ * @brief	This routine inserts a freshly split node right after left.
+ * 			Counts of the ancestors don't change, since the rows
+ * 			of the new node used to belong to left.
+ */
+static void document_insert_child(document_node_t *left,
+								  document_node_t *child)
+{
+	document_node_t *parent = left->parent;
+
+	if (parent == NULL) {
+		parent = document_new_node(0);
+		parent->children[0] = left;
+		parent->children[1] = child;
+		parent->count = 2;
+		parent->rows = left->rows + child->rows;
+		parent->bytes = left->bytes + child->bytes;
+		left->parent = parent;
+		child->parent = parent;
+		roku_config.document = parent;
+		return;
+	}
+
+	int pos = document_child_index(left) + 1;
+	document_node_t *right = NULL;
+
+	if (parent->count == DOCUMENT_FANOUT) {
+		// appending to a full node starts a new one,
+		// which keeps sequentially built trees dense
+		int split = pos == parent->count ? pos : parent->count / 2;
+
+		right = document_new_node(0);
+		right->count = parent->count - split;
+		memcpy(right->children, &parent->children[split],
+			   sizeof(document_node_t *) * right->count);
+		parent->count = split;
+
+		for (int i = 0; i < right->count; i++) {
+			right->children[i]->parent = right;
+		}
+	}
+
+	document_node_t *target = parent;
+	if (right && pos >= parent->count) {
+		target = right;
+		pos -= parent->count;
+	}
+
+	memmove(&target->children[pos + 1], &target->children[pos],
+			sizeof(document_node_t *) * (target->count - pos));
+	target->children[pos] = child;
+	target->count++;
+	child->parent = target;
+
+	if (right) {
+		document_sum_rows(parent);
+		document_sum_rows(right);
+		document_insert_child(parent, right);
+	}
+}
+
+/**
+ * @brief	This routine moves the rows from split onwards
+ * 			into a new leaf placed right after the given one.
+ *
+ * @return	New leaf
+ */
+static document_node_t *document_split_leaf(document_node_t *leaf, int split)
+{
+	document_node_t *right = document_new_node(1);
+
+	right->count = leaf->count - split;
+	memcpy(right->offsets, &leaf->offsets[split],
+		   sizeof(size_t) * right->count);
+	memcpy(right->sizes, &leaf->sizes[split], sizeof(int) * right->count);
+	memcpy(right->states, &leaf->states[split], right->count);
+	leaf->count = split;
+	right->rows = right->count;
+	leaf->rows = leaf->count;
+
+	for (int i = 0; i < right->count; i++) {
+		right->bytes += right->sizes[i] + 1;
+	}
+	if (leaf->materialized) {
+		editor_row_t **rows = document_leaf_rows(right);
+		memcpy(rows, &leaf->materialized[split],
+			   sizeof(editor_row_t *) * right->count);
+		for (int i = 0; i < right->count; i++) {
+			if (rows[i]) {
+				rows[i]->leaf = right;
+			}
+		}
+	}
+	leaf->bytes -= right->bytes;
+
+	right->prev = leaf;
+	right->next = leaf->next;
+	if (leaf->next) {
+		leaf->next->prev = right;
+	}
+	leaf->next = right;
+
+	// the new leaf holds some of the materialized rows
+	if (leaf->cached) {
+		document_touch(right);
+	}
+
+	document_insert_child(leaf, right);
+	return right;
+}
+
+/**
+ * @brief	This routine unlinks an empty node from the tree
+ * 			and frees it, along with ancestors left empty.
+ */
+static void document_remove_child(document_node_t *node)
+{
+	document_node_t *parent = node->parent;
+	int pos = document_child_index(node);
+
+	if (node->is_leaf) {
+		if (node->cached) {
+			document_lru_unlink(node);
+		}
+		if (node->prev) {
+			node->prev->next = node->next;
+		}
+		if (node->next) {
+			node->next->prev = node->prev;
+		}
+	}
+
+	memmove(&parent->children[pos], &parent->children[pos + 1],
+			sizeof(document_node_t *) * (parent->count - pos - 1));
+	parent->count--;
+	document_free_node(node);
+
+	if (parent->count == 0 && parent->parent) {
+		document_remove_child(parent);
+	}
+}
+
+/**
+ * @brief	This routine moves count elements of size bytes from start
+ * 			in one array to at in another, closing the gap they leave.
+ */
+static void document_splice(void *to, int to_count, int at, void *from,
+							int from_count, int start, int count, size_t size)
+{
+	char *dst = to, *src = from;
+
+	memmove(dst + (at + count) * size, dst + at * size,
+			(to_count - at) * size);
+	memcpy(dst + at * size, src + start * size, count * size);
+	memmove(src + start * size, src + (start + count) * size,
+			(from_count - start - count) * size);
+}
+
+/**
+ * @brief	This routine moves count rows (or children) of a node
+ * 			from start to at in a sibling with the same parent.
+ * 			Counts of the ancestors don't change.
+ */
+static void document_move(document_node_t *from, int start, int count,
+						  document_node_t *to, int at)
+{
+	if (!from->is_leaf) {
+		document_splice(to->children, to->count, at, from->children,
+						from->count, start, count, sizeof(document_node_t *));
+		for (int i = at; i < at + count; i++) {
+			to->children[i]->parent = to;
+		}
+		from->count -= count;
+		to->count += count;
+		document_sum_rows(from);
+		document_sum_rows(to);
+		return;
+	}
+
+	document_splice(to->offsets, to->count, at, from->offsets, from->count,
+					start, count, sizeof(size_t));
+	document_splice(to->sizes, to->count, at, from->sizes, from->count, start,
+					count, sizeof(int));
+	document_splice(to->states, to->count, at, from->states, from->count,
+					start, count, 1);
+
+	if (from->materialized) {
+		editor_row_t **rows = document_leaf_rows(to);
+		document_splice(rows, to->count, at, from->materialized, from->count,
+						start, count, sizeof(editor_row_t *));
+		for (int i = at; i < at + count; i++) {
+			if (rows[i]) {
+				rows[i]->leaf = to;
+			}
+		}
+		if (from->cached) {
+			document_touch(to);
+		}
+	} else if (to->materialized) {
+		memmove(&to->materialized[at + count], &to->materialized[at],
+				sizeof(editor_row_t *) * (to->count - at));
+		memset(&to->materialized[at], 0, sizeof(editor_row_t *) * count);
+	}
+
+	size_t bytes = 0;
+	for (int i = at; i < at + count; i++) {
+		bytes += to->sizes[i] + 1;
+	}
+	from->count -= count;
+	from->rows = from->count;
+	from->bytes -= bytes;
+	to->count += count;
+	to->rows = to->count;
+	to->bytes += bytes;
+}
+
+/**
+ * @brief	This routine refills a node that fell below half full from
+ * 			a sibling with the same parent. The two are merged if they
+ * 			fit into one node, otherwise they are evened out.
+ */
+static void document_rebalance(document_node_t *node)
+{
+	document_node_t *parent = node->parent;
+	int max = node->is_leaf ? DOCUMENT_LEAF_ROWS : DOCUMENT_FANOUT;
+
+	if (parent == NULL || parent->count < 2 || node->count >= max / 2) {
+		return;
+	}
+
+	// the looked up leaf may move, it is found again from the root
+	cache_leaf = NULL;
+
+	int pos = document_child_index(node);
+	document_node_t *left = node, *right;
+	if (pos + 1 < parent->count) {
+		right = parent->children[pos + 1];
+	} else {
+		left = parent->children[pos - 1];
+		right = node;
+	}
+
+	if (left->count + right->count <= max) {
+		document_move(right, 0, right->count, left, left->count);
+		document_remove_child(right);
+		document_rebalance(parent);
+		return;
+	}
+
+	int half = (left->count + right->count) / 2;
+	if (left->count < half) {
+		document_move(right, 0, half - left->count, left, left->count);
+	} else {
+		document_move(left, half, left->count - half, right, 0);
+	}
+}
+
+/**
+ * @brief	This routine initializes an empty document.
+ */
+void document_init()
+{
+	roku_config.document = document_new_node(1);
+	roku_config.num_rows = 0;
+
+	cache_leaf = roku_config.document;
+	cache_first = 0;
+}
+
+/**
+ * @brief	This routine looks up the leaf containing the specified row.
+ *
+ * @return	Leaf node, index of its first row is stored in first
+ */
+document_node_t *document_find_leaf(int at, int *first)
+{
+	// the last leaf also covers the position right after the last row
+	if (cache_leaf) {
+		int end = cache_first + cache_leaf->count;
+		if (at >= cache_first &&
+			(at < end || (at == end && cache_leaf->next == NULL))) {
+			*first = cache_first;
+			return cache_leaf;
+		}
+		if (at >= end && cache_leaf->next &&
+			at < end + cache_leaf->next->count) {
+			cache_leaf = cache_leaf->next;
+			cache_first = end;
+			*first = cache_first;
+			return cache_leaf;
+		}
+		if (at < cache_first && cache_leaf->prev &&
+			at >= cache_first - cache_leaf->prev->count) {
+			cache_leaf = cache_leaf->prev;
+			cache_first -= cache_leaf->count;
+			*first = cache_first;
+			return cache_leaf;
+		}
+	}
+
+	document_node_t *node = roku_config.document;
+	int base = 0;
+
+	while (!node->is_leaf) {
+		int i;
+		for (i = 0; i < node->count - 1; i++) {
+			if (at < base + node->children[i]->rows) {
+				break;
+			}
+			base += node->children[i]->rows;
+		}
+		node = node->children[i];
+	}
+
+	cache_leaf = node;
+	cache_first = base;
+	*first = base;
+	return node;
+}
+
+/**
+ * @brief	This routine returns the specified row, unless it is
+ * 			still backed by the file mapping. Sequential accesses
+ * 			are served from a cached leaf.
+ *
+ * @return	Row, NULL if it hasn't been materialized
+ */
+editor_row_t *document_row(int at)
+{
+	int first;
+	document_node_t *leaf = document_find_leaf(at, &first);
+	return leaf->materialized ? leaf->materialized[at - first] : NULL;
+}
+
+/**
+ * @brief	This routine returns the materialized rows of a leaf,
+ * 			allocating the array if the leaf doesn't have one yet.
+ */
+editor_row_t **document_leaf_rows(document_node_t *leaf)
+{
+	if (leaf->materialized == NULL) {
+		editor_row_t **rows =
+			calloc(DOCUMENT_LEAF_ROWS, sizeof(editor_row_t *));
+		DOCUMENT_PUBLISH(&leaf->materialized, rows);
+	}
+
+	return leaf->materialized;
+}
+
+/**
+ * @brief	This routine stores a materialized row in its leaf.
+ */
+void document_set_row(document_node_t *leaf, int pos, editor_row_t *row)
+{
+	editor_row_t **rows = document_leaf_rows(leaf);
+	row->leaf = leaf;
+	DOCUMENT_PUBLISH(&rows[pos], row);
+}
+
+/**
+ * @brief	This routine returns a row of a leaf from a thread other
+ * 			than the main one, NULL if it is backed by the file mapping.
+ */
+editor_row_t *document_leaf_row(document_node_t *leaf, int pos)
+{
+	editor_row_t **rows =
+		__atomic_load_n(&leaf->materialized, __ATOMIC_ACQUIRE);
+	if (rows == NULL) {
+		return NULL;
+	}
+
+	return __atomic_load_n(&rows[pos], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief	This routine returns the highlighter state stored
+ * 			for the end of the specified row.
+ */
+unsigned char *document_state(int at)
+{
+	int first;
+	document_node_t *leaf = document_find_leaf(at, &first);
+	return &leaf->states[at - first];
+}
+
+/**
+ * @brief	This routine inserts a row of the specified length before
+ * 			the specified one. Rows backed by the file mapping are
+ * 			inserted as NULL, along with their offset.
+ */
+void document_insert(int at, editor_row_t *row, size_t offset, int len)
+{
+	int first;
+	document_node_t *leaf = document_find_leaf(at, &first);
+	int pos = at - first;
+
+	if (leaf->count == DOCUMENT_LEAF_ROWS) {
+		// appending to a full leaf starts a new one
+		int split = pos == leaf->count ? pos : leaf->count / 2;
+		document_node_t *right = document_split_leaf(leaf, split);
+		if (pos >= split) {
+			leaf = right;
+			first += split;
+			pos -= split;
+		}
+	}
+
+	memmove(&leaf->offsets[pos + 1], &leaf->offsets[pos],
+			sizeof(size_t) * (leaf->count - pos));
+	memmove(&leaf->sizes[pos + 1], &leaf->sizes[pos],
+			sizeof(int) * (leaf->count - pos));
+	memmove(&leaf->states[pos + 1], &leaf->states[pos], leaf->count - pos);
+	if (row || leaf->materialized) {
+		editor_row_t **rows = document_leaf_rows(leaf);
+		memmove(&rows[pos + 1], &rows[pos],
+				sizeof(editor_row_t *) * (leaf->count - pos));
+		rows[pos] = row;
+	}
+	leaf->offsets[pos] = offset;
+	leaf->sizes[pos] = len;
+	leaf->states[pos] = 0;
+	leaf->count++;
+	document_adjust(leaf, 1, len + 1);
+	if (row) {
+		row->leaf = leaf;
+	}
+	roku_config.num_rows++;
+	roku_config.edits++;
+
+	cache_leaf = leaf;
+	cache_first = first;
+}
+
+/**
+ * @brief	This routine removes the specified row.
+ * 			The row itself has to be freed by the caller.
+ */
+void document_remove(int at)
+{
+	int first;
+	document_node_t *leaf = document_find_leaf(at, &first);
+	int pos = at - first;
+	size_t bytes = leaf->sizes[pos] + 1;
+
+	memmove(&leaf->offsets[pos], &leaf->offsets[pos + 1],
+			sizeof(size_t) * (leaf->count - pos - 1));
+	if (leaf->materialized) {
+		memmove(&leaf->materialized[pos], &leaf->materialized[pos + 1],
+				sizeof(editor_row_t *) * (leaf->count - pos - 1));
+	}
+	memmove(&leaf->sizes[pos], &leaf->sizes[pos + 1],
+			sizeof(int) * (leaf->count - pos - 1));
+	memmove(&leaf->states[pos], &leaf->states[pos + 1], leaf->count - pos - 1);
+	leaf->count--;
+	document_adjust(leaf, -1, -(long)bytes);
+	roku_config.num_rows--;
+	roku_config.edits++;
+
+	cache_leaf = leaf;
+	cache_first = first;
+
+	if (leaf->parent == NULL) {
+		return;
+	}
+
+	if (leaf->count > 0 || leaf->parent->count > 1) {
+		document_rebalance(leaf);
+	} else {
+		// the only child of its parent, which goes along with it
+		if (leaf->next) {
+			cache_leaf = leaf->next;
+		} else {
+			cache_leaf = leaf->prev;
+			cache_first -= cache_leaf->count;
+		}
+		document_remove_child(leaf);
+	}
+
+	// collapse inner nodes left with a single child
+	document_node_t *root = roku_config.document;
+	while (!root->is_leaf && root->count == 1) {
+		roku_config.document = root->children[0];
+		roku_config.document->parent = NULL;
+		document_free_node(root);
+		root = roku_config.document;
+	}
+}
+
+/**
+ * @brief	This routine marks a leaf as the most recently used one
+ * 			holding materialized rows.
+ */
+void document_touch(document_node_t *leaf)
+{
+	if (leaf == lru_head) {
+		return;
+	}
+
+	if (leaf->cached) {
+		document_lru_unlink(leaf);
+	}
+
+	leaf->lru_next = lru_head;
+	if (lru_head) {
+		lru_head->lru_prev = leaf;
+	} else {
+		lru_tail = leaf;
+	}
+	lru_head = leaf;
+	leaf->cached = 1;
+	lru_count++;
+}
+
+/**
+ * @brief	This routine takes the least recently used leaf off the list
+ * 			once more leaves than allowed hold materialized rows.
+ *
+ * @return	Leaf whose rows should be released, NULL if within budget
+ */
+document_node_t *document_cold_leaf()
+{
+	if (lru_hold > 0 || lru_count <= ROW_CACHE_LEAVES) {
+		return NULL;
+	}
+
+	document_node_t *leaf = lru_tail;
+	document_lru_unlink(leaf);
+	return leaf;
+}
+
+/**
+ * @brief	This routine keeps materialized rows from being released
+ * 			while other threads read the leaves.
+ */
+void document_hold()
+{
+	lru_hold++;
+}
+
+/**
+ * @brief	This routine allows materialized rows to be released again.
+ */
+void document_release()
+{
+	lru_hold--;
+}
+
+/**
+ * @brief	This routine checks whether other threads are reading
+ * 			the leaves, so the tree must not be changed.
+ */
+int document_held()
+{
+	return lru_hold > 0;
+}
+
+/**
+ * @brief	This routine returns the position of a row in its leaf.
+ */
+static int document_leaf_index(editor_row_t *row)
+{
+	editor_row_t **rows = row->leaf->materialized;
+	int i = 0;
+
+	while (rows[i] != row) {
+		i++;
+	}
+
+	return i;
+}
+
+/**
+ * @brief	This routine updates the byte counts of the document
+ * 			after the size of a row has changed.
+ */
+void document_update_size(editor_row_t *row)
+{
+	if (row->leaf == NULL) {
+		return;
+	}
+
+	int *size = &row->leaf->sizes[document_leaf_index(row)];
+	if (row->size != *size) {
+		document_adjust(row->leaf, 0, row->size - *size);
+		*size = row->size;
+	}
+}
+
+/**
+ * @brief	This routine returns the index of a row in the document.
+ */
+int document_row_index(editor_row_t *row)
+{
+	document_node_t *node = row->leaf;
+	int at = document_leaf_index(row);
+
+	for (; node->parent; node = node->parent) {
+		document_node_t **children = node->parent->children;
+		for (int i = 0; children[i] != node; i++) {
+			at += children[i]->rows;
+		}
+	}
+
+	return at;
+}
+
+/**
+ * @brief	This routine returns the byte offset of the specified row.
+ */
+size_t document_offset(int at)
+{
+	if (at >= roku_config.num_rows) {
+		return roku_config.document->bytes;
+	}
+
+	int first;
+	document_node_t *node = document_find_leaf(at, &first);
+	size_t offset = 0;
+
+	for (int i = 0; i < at - first; i++) {
+		offset += node->sizes[i] + 1;
+	}
+
+	// add up the siblings in front of every ancestor
+	for (; node->parent; node = node->parent) {
+		document_node_t **children = node->parent->children;
+		for (int i = 0; children[i] != node; i++) {
+			offset += children[i]->bytes;
+		}
+	}
+
+	return offset;
+}
+
+/**
+ * @brief	This routine looks up the row containing a byte offset.
+ *
+ * @return	Row index, offset of the byte in the row is stored in col
+ */
+int document_find_offset(size_t offset, int *col)
+{
+	document_node_t *node = roku_config.document;
+	int row = 0;
+
+	if (offset >= node->bytes) {
+		*col = 0;
+		return roku_config.num_rows;
+	}
+
+	while (!node->is_leaf) {
+		int i;
+		for (i = 0; i < node->count - 1; i++) {
+			if (offset < node->children[i]->bytes) {
+				break;
+			}
+			offset -= node->children[i]->bytes;
+			row += node->children[i]->rows;
+		}
+		node = node->children[i];
+	}
+
+	for (int i = 0; i < node->count; i++) {
+		size_t bytes = node->sizes[i] + 1;
+		if (offset < bytes) {
+			*col = offset;
+			return row + i;
+		}
+		offset -= bytes;
+	}
+
+	*col = 0;
+	return row + node->count;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file:		src/document.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the document engine. Rows are kept
+ * 				in fixed-size chunks stored in the leaves of a balanced
+ * 				tree, so inserting or removing a row costs O(log n).
+ */
+
+#ifndef __DOCUMENT_H_
+#define __DOCUMENT_H_
+
+#include "roku.h"
+
+// maximum number of rows in a leaf
+#define DOCUMENT_LEAF_ROWS 512
+// maximum number of children of an inner node
+#define DOCUMENT_FANOUT 32
+
+/**
+ * @brief	This structure is a node of the document tree.
+ * 			Leaves hold rows and are linked together
+ * 			in document order, inner nodes hold children.
+ */
+struct document_node {
+	struct document_node *parent;
+	struct document_node *prev, *next;
+	int is_leaf;
+	int count;
+	int rows;
+	// bytes of the rows, counting a newline after each
+	size_t bytes;
+	struct document_node **children;
+	// rows of a leaf are kept in parallel arrays: the offset of each
+	// row in the file mapping and its length without the newline, and
+	// the rows turned into an editor_row_t, NULL until there are any
+	size_t *offsets;
+	int *sizes;
+	editor_row_t **materialized;
+	// state of the highlighter at the end of each row
+	unsigned char *states;
+	// position in the list of leaves holding materialized rows
+	struct document_node *lru_prev, *lru_next;
+	int cached;
+};
+
+typedef struct document_node document_node_t;
+
+/**
+ * @brief	This routine initializes an empty document.
+ */
+void document_init();
+
+/**
+ * @brief	This routine returns the specified row, unless it is
+ * 			still backed by the file mapping. Sequential accesses
+ * 			are served from a cached leaf.
+ *
+ * @return	Row, NULL if it hasn't been materialized
+ */
+editor_row_t *document_row(int at);
+
+/**
+ * @brief	This routine returns the materialized rows of a leaf,
+ * 			allocating the array if the leaf doesn't have one yet.
+ */
+editor_row_t **document_leaf_rows(document_node_t *leaf);
+
+/**
+ * @brief	This routine stores a materialized row in its leaf.
+ */
+void document_set_row(document_node_t *leaf, int pos, editor_row_t *row);
+
+/**
+ * @brief	This routine returns a row of a leaf from a thread other
+ * 			than the main one, NULL if it is backed by the file mapping.
+ */
+editor_row_t *document_leaf_row(document_node_t *leaf, int pos);
+
+/**
+ * @brief	This routine returns the highlighter state stored
+ * 			for the end of the specified row.
+ */
+unsigned char *document_state(int at);
+
+/**
+ * @brief	This routine inserts a row of the specified length before
+ * 			the specified one. Rows backed by the file mapping are
+ * 			inserted as NULL, along with their offset.
+ */
+void document_insert(int at, editor_row_t *row, size_t offset, int len);
+
+/**
+ * @brief	This routine removes the specified row.
+ * 			The row itself has to be freed by the caller.
+ */
+void document_remove(int at);
+
+/**
+ * @brief	This routine looks up the leaf containing the specified row.
+ *
+ * @return	Leaf node, index of its first row is stored in first
+ */
+document_node_t *document_find_leaf(int at, int *first);
+
+/**
+ * @brief	This routine marks a leaf as the most recently used one
+ * 			holding materialized rows.
+ */
+void document_touch(document_node_t *leaf);
+
+/**
+ * @brief	This routine takes the least recently used leaf off the list
+ * 			once more leaves than allowed hold materialized rows.
+ *
+ * @return	Leaf whose rows should be released, NULL if within budget
+ */
+document_node_t *document_cold_leaf();
+
+/**
+ * @brief	This routine keeps materialized rows from being released
+ * 			while other threads read the leaves.
+ */
+void document_hold();
+
+/**
+ * @brief	This routine allows materialized rows to be released again.
+ */
+void document_release();
+
+/**
+ * @brief	This routine checks whether other threads are reading
+ * 			the leaves, so the tree must not be changed.
+ */
+int document_held();
+
+/**
+ * @brief	This routine updates the byte counts of the document
+ * 			after the size of a row has changed.
+ */
+void document_update_size(editor_row_t *row);
+
+/**
+ * @brief	This routine returns the index of a row in the document.
+ */
+int document_row_index(editor_row_t *row);
+
+/**
+ * @brief	This routine returns the byte offset of the specified row.
+ */
+size_t document_offset(int at);
+
+/**
+ * @brief	This routine looks up the row containing a byte offset.
+ *
+ * @return	Row index, offset of the byte in the row is stored in col
+ */
+int document_find_offset(size_t offset, int *col);
+
+#endif // __DOCUMENT_H_
@@ -6,8 +6,10 @@
  * 				keyboard input.
  */
 
+#include <sys/mman.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -17,15 +19,89 @@
 #include "config.h"
 #include "input.h"
 #include "editor.h"
+#include "document.h"
+#include "file.h"
+#include "find.h"
+#include "highlight.h"
+#include "undo.h"
+#include "utf8.h"
+#include "screen.h"
 #include "roku.h"
 
+// rows currently holding a render buffer
+static editor_row_t **render_rows = NULL;
+static int render_count = 0;
+static int render_capacity = 0;
+static unsigned int render_frame = 0;
+
+// output buffer reused by every frame
+static struct append_buf frame_buf = APPEND_BUF_INIT;
+
+/**
+ * @brief	Storage of a row in a slab. Free rows are linked together.
+ */
+typedef union editor_slab_cell {
+	editor_row_t row;
+	union editor_slab_cell *next;
+} editor_slab_cell_t;
+
+// rows are carved out of slabs, freed ones are reused first
+static editor_slab_cell_t *slab_free = NULL;
+static editor_slab_cell_t *slab_next = NULL;
+static int slab_left = 0;
+
+/**
+ * @brief	This routine finds where the render buffer of a row reaches
+ * 			the specified column. If a wide character straddles it,
+ * 			the character is skipped and pad is set to the number
+ * 			of columns it leaves blank.
+ *
+ * @return	Offset into the render buffer
+ */
+static int editor_render_offset(editor_row_t *row, int col, int *pad)
+{
+	*pad = 0;
+	if (row->flags & ROW_WINDOW) {
+		// the window was rendered starting at the column scrolled to
+		return 0;
+	}
+	if (row->flags & ROW_PLAIN) {
+		return col < row->render_size ? col : row->render_size;
+	}
+
+	int i = 0, x = 0;
+	while (i < row->render_size && x < col) {
+		int cp;
+		i += utf8_decode(&row->render[i], row->render_size - i, &cp);
+		x += cp == -1 ? 1 : utf8_width(cp);
+	}
+
+	// combining marks belong to the character that was skipped
+	while (i < row->render_size) {
+		int cp;
+		int n = utf8_decode(&row->render[i], row->render_size - i, &cp);
+		if (cp == -1 || utf8_width(cp) != 0) {
+			break;
+		}
+		i += n;
+	}
+
+	*pad = x - col;
+	return i;
+}
+
 /**
  * @brief	This routine draws every row on the screen.
  * 			If a row hasn't been specified to be drawn,
  * 			the first character of it is replaced by a tilde (~).
  */
-void editor_draw_row(struct append_buf *buf)
+void editor_draw_row()
 {
+	render_frame++;
+
+	// rows are only highlighted as far down as they are drawn
+	highlight_update(roku_config.row_off + roku_config.window_size.rows - 1);
+
 	for (int y = 0; y < roku_config.window_size.rows; y++) {
 		int file_row = y + roku_config.row_off;
 		if (file_row >= roku_config.num_rows) {
@@ -42,47 +118,59 @@ void editor_draw_row(struct append_buf *buf)
 				int padding =
 					(roku_config.window_size.cols - welcome_msg_len) / 2;
 				if (padding) {
-					editor_buffer_append(buf, "~", 1);
-					padding--;
-				}
-
-				while (padding--) {
-					editor_buffer_append(buf, " ", 1);
+					screen_put(y, 0, "~", 1, SCREEN_ATTR_NORMAL);
 				}
 
-				editor_buffer_append(buf, welcome_msg, welcome_msg_len);
+				screen_put(y, padding, welcome_msg, welcome_msg_len,
+						   SCREEN_ATTR_NORMAL);
 			} else {
-				editor_buffer_append(buf, "~", 1);
+				screen_put(y, 0, "~", 1, SCREEN_ATTR_NORMAL);
 			}
 		} else {
-			int len =
-				roku_config.row[file_row].render_size - roku_config.col_off;
-			if (len < 0) {
-				len = 0;
+			editor_row_t *row = editor_get_row(file_row);
+			editor_render_row(row);
+			highlight_row(row, file_row);
+			row->render_frame = render_frame;
+
+			// a wide character cut off on the left leaves blanks
+			int x;
+			int start = editor_render_offset(row, roku_config.col_off, &x);
+			int len = row->render_size - start;
+			if ((row->flags & ROW_PLAIN) && len > roku_config.window_size.cols) {
+				len = roku_config.window_size.cols;
 			}
 
-			if (len > roku_config.window_size.cols) {
-				len = roku_config.window_size.cols;
+			const char *render = &row->render[start];
+			if (row->hl == NULL) {
+				screen_put(y, x, render, len, SCREEN_ATTR_NORMAL);
+				continue;
 			}
 
-			editor_buffer_append(
-				buf, &roku_config.row[file_row].render[roku_config.col_off],
-				len);
+			// characters of the same attribute are put as one run
+			const unsigned char *hl = &row->hl[start];
+			int i = 0;
+			while (i < len && x < roku_config.window_size.cols) {
+				int end = i + 1;
+				while (end < len && hl[end] == hl[i]) {
+					end++;
+				}
+				x += screen_put(y, x, render + i, end - i, hl[i]);
+				i = end;
+			}
 		}
-
-		editor_buffer_append(buf, "\x1b[K", 3);
-		editor_buffer_append(buf, "\r\n", 2);
 	}
 
-	write(STDOUT_FILENO, "\x1b[H]", 3);
+	editor_evict_renders();
+	editor_evict_rows();
 }
 
 /**
  * @brief	This routine draws a status bar at the bottom of the terminal window
  */
-void editor_draw_statusbar(struct append_buf *buf)
+void editor_draw_statusbar()
 {
-	editor_buffer_append(buf, "\x1b[7m", 4);
+	int y = roku_config.window_size.rows;
+	screen_fill(y, 0, roku_config.window_size.cols, SCREEN_ATTR_INVERSE);
 
 	char status[80];
 	// this text is aligned to the right edge of the window.
@@ -92,49 +180,70 @@ void editor_draw_statusbar(struct append_buf *buf)
 		status, sizeof(status), "%.20s - %d lines%s",
 		roku_config.filename ? roku_config.filename : "[No Name]",
 		roku_config.num_rows, roku_config.file_dirty ? " (modified)" : "");
-	int rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d",
-						roku_config.cur_y + 1, roku_config.num_rows);
+	// line and byte offset of the cursor
+	char pos[48];
+	snprintf(pos, sizeof(pos), "%d/%d @%zu", roku_config.cur_y + 1,
+			 roku_config.num_rows,
+			 document_offset(roku_config.cur_y) + roku_config.cur_x);
+
+	int rlen;
+	int progress = file_save_progress();
+	int loading = file_load_progress();
+	int k, matches = find_match_count(&k);
+	const char *error = find_error();
+	if (error) {
+		rlen = snprintf(rstatus, sizeof(rstatus), "%.30s | %s", error, pos);
+	} else if (matches == 0) {
+		rlen = snprintf(rstatus, sizeof(rstatus), "no matches | %s", pos);
+	} else if (matches != -1) {
+		rlen = snprintf(rstatus, sizeof(rstatus), "match %d of %d | %s", k,
+						matches, pos);
+	} else if (loading != -1) {
+		rlen = snprintf(rstatus, sizeof(rstatus), "loading %d%% | %s",
+						loading, pos);
+	} else if (progress != -1) {
+		rlen = snprintf(rstatus, sizeof(rstatus), "saving %d%% | %s",
+						progress, pos);
+	} else {
+		rlen = snprintf(rstatus, sizeof(rstatus), "%s", pos);
+	}
 	if (len > roku_config.window_size.cols) {
 		len = roku_config.window_size.cols;
 	}
 
-	editor_buffer_append(buf, status, len);
+	screen_put(y, 0, status, len, SCREEN_ATTR_INVERSE);
 
-	while (len < roku_config.window_size.cols) {
-		if (roku_config.window_size.cols - len == rlen) {
-			editor_buffer_append(buf, rstatus, rlen);
-			break;
-		} else {
-			editor_buffer_append(buf, " ", 1);
-			len++;
-		}
+	if (len + rlen <= roku_config.window_size.cols) {
+		screen_put(y, roku_config.window_size.cols - rlen, rstatus, rlen,
+				   SCREEN_ATTR_INVERSE);
 	}
-	editor_buffer_append(buf, "\x1b[m", 3);
-	editor_buffer_append(buf, "\r\n", 2);
 }
 
 /**
  * @brief	This routine draws a message bar below the status bar
  */
-void editor_draw_messagebar(struct append_buf *buf)
+void editor_draw_messagebar()
 {
-	editor_buffer_append(buf, "\x1b[K", 3);
-
 	int msg_len = strlen(roku_config.status_msg);
 	if (msg_len > roku_config.window_size.cols) {
 		msg_len = roku_config.window_size.cols;
 	}
-	if (msg_len && time(NULL) - roku_config.status_msg_time < 5) {
-		editor_buffer_append(buf, roku_config.status_msg, msg_len);
+	if (msg_len &&
+		time(NULL) - roku_config.status_msg_time < STATUS_MSG_TIMEOUT) {
+		screen_put(roku_config.window_size.rows + 1, 0, roku_config.status_msg,
+				   msg_len, SCREEN_ATTR_NORMAL);
 	}
 }
 
 /**
  * @brief	This routine displays a prompt in the message bar.
  * 
+ * 			Empty input is only accepted if allow_empty is set.
+ * 
  * @return	User's input.
  */
-char *editor_display_prompt(char *prompt, void *(callback)(char *, int))
+char *editor_display_prompt(char *prompt, void *(callback)(char *, int),
+							int allow_empty)
 {
 	size_t bufsize = 128;
 	char *buf = malloc(bufsize);
@@ -148,9 +257,14 @@ char *editor_display_prompt(char *prompt, void *(callback)(char *, int))
 
 		int c = input_get_keypress();
 		if (c == DEL_KEY || c == BACKSPACE) {
+			// the whole of a multi-byte character goes at once
+			while (buflen != 0 && UTF8_IS_CONT(buf[buflen - 1])) {
+				buflen--;
+			}
 			if (buflen != 0) {
-				buf[--buflen] = '\0';
+				buflen--;
 			}
+			buf[buflen] = '\0';
 		} else if (c == '\x1b') {
 			editor_set_status("");
 			if (callback) {
@@ -159,14 +273,28 @@ char *editor_display_prompt(char *prompt, void *(callback)(char *, int))
 			free(buf);
 			return NULL;
 		} else if (c == '\r' || c == '\n') {
-			if (buflen != 0) {
+			if (buflen != 0 || allow_empty) {
 				if (callback) {
 					callback(buf, c);
 				}
 				editor_set_status("");
 				return buf;
 			}
-		} else if (!iscntrl(c) && c < 128) {
+		} else if (c == PASTE) {
+			int len;
+			const char *text = input_get_paste(&len);
+			for (int i = 0; i < len; i++) {
+				if (iscntrl((unsigned char)text[i])) {
+					continue;
+				}
+				if (buflen == bufsize - 1) {
+					bufsize *= 2;
+					buf = realloc(buf, bufsize);
+				}
+				buf[buflen++] = text[i];
+				buf[buflen] = '\0';
+			}
+		} else if (c < 256 && !iscntrl(c)) {
 			if (buflen == bufsize - 1) {
 				bufsize *= 2;
 				buf = realloc(buf, bufsize);
@@ -202,21 +330,21 @@ void editor_move_curpos(int key)
 	if (roku_config.cur_y >= roku_config.num_rows) {
 		row = NULL;
 	} else {
-		row = &roku_config.row[roku_config.cur_y];
+		row = editor_get_row(roku_config.cur_y);
 	}
 
 	switch (key) {
 	case ARROW_LEFT:
 		if (roku_config.cur_x != 0) {
-			roku_config.cur_x--;
+			roku_config.cur_x = editor_row_prev(row, roku_config.cur_x);
 		} else if (roku_config.cur_y > 0) {
 			roku_config.cur_y--;
-			roku_config.cur_x = roku_config.row[roku_config.cur_y].size;
+			roku_config.cur_x = editor_get_row(roku_config.cur_y)->size;
 		}
 		break;
 	case ARROW_RIGHT:
 		if (row && roku_config.cur_x < row->size) {
-			roku_config.cur_x++;
+			roku_config.cur_x = editor_row_next(row, roku_config.cur_x);
 		} else if (row && roku_config.cur_x == row->size) {
 			roku_config.cur_y++;
 			roku_config.cur_x = 0;
@@ -239,13 +367,129 @@ void editor_move_curpos(int key)
 	if (roku_config.cur_y >= roku_config.num_rows) {
 		row = NULL;
 	} else {
-		row = &roku_config.row[roku_config.cur_y];
+		row = editor_get_row(roku_config.cur_y);
 	}
 
 	int row_len = row ? row->size : 0;
 	if (roku_config.cur_x > row_len) {
 		roku_config.cur_x = row_len;
 	}
+
+	// don't end up inside of a multi-byte character
+	while (roku_config.cur_x > 0 && roku_config.cur_x < row_len &&
+		   UTF8_IS_CONT(ROW_CHAR(row, roku_config.cur_x))) {
+		roku_config.cur_x--;
+	}
+}
+
+/**
+ * @brief	This routine moves the cursor a screen up or down.
+ */
+void editor_move_page(int key)
+{
+	int rows = roku_config.window_size.rows;
+
+	if (key == PAGE_UP) {
+		roku_config.cur_y = roku_config.row_off - rows;
+		if (roku_config.cur_y < 0) {
+			roku_config.cur_y = 0;
+		}
+	} else {
+		roku_config.cur_y = roku_config.row_off + 2 * rows - 1;
+		if (roku_config.cur_y > roku_config.num_rows) {
+			roku_config.cur_y = roku_config.num_rows;
+		}
+	}
+
+	// keeps the cursor inside of the new row
+	editor_move_curpos(key);
+}
+
+/**
+ * @brief	This routine scrolls the cursor row to the middle
+ * 			of the screen.
+ */
+static void editor_center_cursor()
+{
+	roku_config.row_off = roku_config.cur_y - roku_config.window_size.rows / 2;
+	if (roku_config.row_off < 0) {
+		roku_config.row_off = 0;
+	}
+}
+
+/**
+ * @brief	This routine moves the cursor to the start of a line.
+ * 			Lines are numbered from 1.
+ */
+void editor_goto_line(int line)
+{
+	if (line < 1) {
+		line = 1;
+	}
+	if (line > roku_config.num_rows) {
+		line = roku_config.num_rows ? roku_config.num_rows : 1;
+	}
+
+	roku_config.cur_y = line - 1;
+	roku_config.cur_x = 0;
+	editor_center_cursor();
+}
+
+/**
+ * @brief	This routine moves the cursor to a byte offset,
+ * 			counting a newline after every line.
+ */
+void editor_goto_byte(size_t offset)
+{
+	int col;
+	roku_config.cur_y = document_find_offset(offset, &col);
+	roku_config.cur_x = 0;
+
+	if (roku_config.cur_y < roku_config.num_rows) {
+		editor_row_t *row = editor_get_row(roku_config.cur_y);
+		if (col > row->size) {
+			col = row->size;
+		}
+
+		// don't end up inside of a multi-byte character
+		while (col > 0 && col < row->size && UTF8_IS_CONT(ROW_CHAR(row, col))) {
+			col--;
+		}
+		roku_config.cur_x = col;
+	}
+	editor_center_cursor();
+}
+
+/**
+ * @brief	This routine asks for a line, or for a byte offset
+ * 			prefixed with '@', and moves the cursor there.
+ */
+void editor_goto()
+{
+	char *input =
+		editor_display_prompt("Go to line (@ for byte): %s", NULL, 0);
+	if (input == NULL) {
+		return;
+	}
+
+	char *end;
+	if (input[0] == '@') {
+		unsigned long long offset = strtoull(input + 1, &end, 10);
+		if (end != input + 1 && *end == '\0') {
+			editor_goto_byte(offset);
+		} else {
+			editor_set_status("Invalid byte offset: %.40s", input + 1);
+		}
+	} else {
+		long line = strtol(input, &end, 10);
+		if (*end == '\0') {
+			editor_goto_line(line > INT_MAX ? INT_MAX : line);
+		} else {
+			editor_set_status("Invalid line number: %.40s", input);
+		}
+	}
+
+	free(input);
 }
 
 /**
@@ -258,20 +502,63 @@ void editor_init()
 	roku_config.render_x = 0;
 	roku_config.row_off = 0;
 	roku_config.col_off = 0;
-	roku_config.num_rows = 0;
-	roku_config.row = NULL;
+	document_init();
+	roku_config.file_map = NULL;
+	roku_config.file_map_size = 0;
+	roku_config.file_map_owned = 0;
 	roku_config.file_dirty = 0;
 	roku_config.filename = NULL;
 	roku_config.status_msg[0] = '\0';
 	roku_config.status_msg_time = 0;
 
-	if (terminal_get_window_size(&roku_config.window_size.rows,
-								 &roku_config.window_size.cols) == -1) {
-		die("terminal_get_window_size: couldn't get window size");
+	if (editor_update_window_size() == -1) {
+		die("editor_update_window_size: couldn't get window size");
+	}
+}
+
+/**
+ * @brief	This routine fetches the terminal window size
+ * 			and resizes the screen to fit it.
+ *
+ * @return	status code
+ */
+int editor_update_window_size()
+{
+	int rows, cols;
+
+	if (roku_config.output->window_size(&rows, &cols) == -1) {
+		return -1;
+	}
+
+	// status bar & message bar need two rows
+	if (rows < 3) {
+		rows = 3;
 	}
 
-	// status bar & message bar
-	roku_config.window_size.rows -= 2;
+	screen_resize(rows, cols);
+	roku_config.window_size.rows = rows - 2;
+	roku_config.window_size.cols = cols;
+	return 0;
+}
+
+/**
+ * @brief	This routine returns the time left until the status
+ * 			message has to be cleared from the screen.
+ *
+ * @return	Timeout in milliseconds, -1 if there is nothing to clear
+ */
+int editor_status_timeout()
+{
+	if (roku_config.status_msg[0] == '\0') {
+		return -1;
+	}
+
+	time_t left =
+		roku_config.status_msg_time + STATUS_MSG_TIMEOUT - time(NULL);
+	if (left <= 0) {
+		return -1;
+	}
+	return left * 1000;
 }
 
 /**
@@ -283,11 +570,92 @@ void editor_insert_char(int c)
 		editor_append_row(roku_config.num_rows, "", 0);
 	}
 
-	editor_insert_into_row(&roku_config.row[roku_config.cur_y],
-						   roku_config.cur_x, c);
+	undo_typed();
+	editor_insert_into_row(editor_get_row(roku_config.cur_y), roku_config.cur_x,
+						   c);
 	roku_config.cur_x++;
 }
 
+/**
+ * @brief	This routine returns the end of the line starting at s.
+ * 			Lines may end with \n, \r\n or a lone \r.
+ */
+static const char *editor_line_end(const char *s, const char *end)
+{
+	while (s < end && *s != '\n' && *s != '\r') {
+		s++;
+	}
+	return s;
+}
+
+/**
+ * @brief	This routine skips the line ending at s.
+ */
+static const char *editor_skip_newline(const char *s, const char *end)
+{
+	if (s < end && *s == '\r') {
+		s++;
+	}
+	if (s < end && *s == '\n') {
+		s++;
+	}
+	return s;
+}
+
+/**
+ * @brief	This routine inserts a block of text at the cursor,
+ * 			splitting it into rows in a single pass.
+ */
+void editor_insert_text(const char *s, int len)
+{
+	const char *end = s + len;
+	const char *line_end = editor_line_end(s, end);
+
+	if (len == 0) {
+		return;
+	}
+	if (roku_config.cur_y == roku_config.num_rows) {
+		editor_append_row(roku_config.num_rows, "", 0);
+	}
+
+	editor_row_t *row = editor_get_row(roku_config.cur_y);
+
+	if (line_end == end) {
+		editor_row_insert(row, roku_config.cur_x, s, len);
+		roku_config.file_dirty++;
+		roku_config.cur_x += len;
+		return;
+	}
+
+	// the text after the cursor ends up behind the last inserted line
+	editor_row_own(row);
+	editor_row_move_gap(row, roku_config.cur_x);
+	int tail_len = row->size - roku_config.cur_x;
+	char *tail = malloc(tail_len + 1);
+	memcpy(tail, &row->buf[row->gap + row->gap_len], tail_len);
+	editor_row_delete(row, roku_config.cur_x, tail_len);
+
+	editor_row_append_string(row, s, line_end - s);
+
+	int at = roku_config.cur_y + 1;
+	s = editor_skip_newline(line_end, end);
+	while ((line_end = editor_line_end(s, end)) != end) {
+		editor_append_row(at++, s, line_end - s);
+		s = editor_skip_newline(line_end, end);
+	}
+
+	int last_len = end - s;
+	char *last = malloc(last_len + tail_len + 1);
+	memcpy(last, s, last_len);
+	memcpy(&last[last_len], tail, tail_len);
+	editor_append_row(at, last, last_len + tail_len);
+	free(last);
+	free(tail);
+
+	roku_config.cur_y = at;
+	roku_config.cur_x = last_len;
+}
+
 /**
  * @brief	This routine deletes a character from the current row
  */
@@ -300,21 +668,24 @@ void editor_remove_char()
 		return;
 	}
 
-	editor_row_t *row = &roku_config.row[roku_config.cur_y];
+	editor_row_t *row = editor_get_row(roku_config.cur_y);
 	if (roku_config.cur_x > 0) {
-		editor_remove_from_row(row, roku_config.cur_x - 1);
-		roku_config.cur_x--;
+		roku_config.cur_x = editor_row_prev(row, roku_config.cur_x);
+		undo_typed();
+		editor_remove_from_row(row, roku_config.cur_x);
 	} else {
-		roku_config.cur_x = roku_config.row[roku_config.cur_y - 1].size;
-		editor_row_append_string(&roku_config.row[roku_config.cur_y - 1],
-								 row->buf, row->size);
+		editor_row_t *prev = editor_get_row(roku_config.cur_y - 1);
+		roku_config.cur_x = prev->size;
+		editor_row_close_gap(row);
+		editor_row_append_string(prev, row->buf, row->size);
 		editor_remove_row(roku_config.cur_y);
 		roku_config.cur_y--;
 	}
 }
 
 /**
- * @brief	This routine removes a character from the current row buffer.
+ * @brief	This routine removes a character from the current row buffer,
+ * 			along with the combining marks following it.
  */
 void editor_remove_from_row(editor_row_t *row, int at)
 {
@@ -322,9 +693,7 @@ void editor_remove_from_row(editor_row_t *row, int at)
 		return;
 	}
 
-	memmove(&row->buf[at], &row->buf[at + 1], row->size - at);
-	row->size--;
-	editor_update_row(row);
+	editor_row_delete(row, at, editor_row_next(row, at) - at);
 	roku_config.file_dirty++;
 }
 
@@ -337,54 +706,485 @@ void editor_insert_into_row(editor_row_t *row, int at, int c)
 		at = row->size;
 	}
 
-	row->buf = realloc(row->buf, row->size + 2);
-	memmove(&row->buf[at + 1], &row->buf[at], row->size - at + 1);
-	row->size++;
-	row->buf[at] = c;
-	editor_update_row(row);
+	char ch = c;
+	editor_row_insert(row, at, &ch, 1);
 	roku_config.file_dirty++;
 }
 
+/**
+ * @brief	This routine throws away the column checkpoints of a row
+ * 			that an edit at the specified index may have moved.
+ */
+static void editor_row_forget_columns(editor_row_t *row, int at)
+{
+	// a character is at most 4 bytes long, so the ones starting further
+	// back than that can't have been joined with the edited bytes
+	while (row->checkpoint_count > 1 &&
+		   row->checkpoints[row->checkpoint_count - 1].at > at - 4) {
+		row->checkpoint_count--;
+	}
+}
+
+/**
+ * @brief	This routine finds the last column checkpoint of a long row
+ * 			that is at or before both the specified index and column.
+ * 			Missing checkpoints are computed from the last one known.
+ */
+static editor_checkpoint_t *editor_row_checkpoint(editor_row_t *row, int at,
+												  int rx)
+{
+	if (row->checkpoints == NULL) {
+		row->checkpoint_capacity = row->size / ROW_CHECKPOINT + 1;
+		row->checkpoints =
+			malloc(sizeof(editor_checkpoint_t) * row->checkpoint_capacity);
+		row->checkpoints[0].at = 0;
+		row->checkpoints[0].rx = 0;
+		row->checkpoint_count = 1;
+	}
+
+	while (row->checkpoint_count * ROW_CHECKPOINT <= at) {
+		editor_checkpoint_t *last = &row->checkpoints[row->checkpoint_count - 1];
+		if (last->rx > rx) {
+			break;
+		}
+
+		int next = row->checkpoint_count * ROW_CHECKPOINT;
+		int i = last->at;
+		int render_x = last->rx;
+		while (i < next && i < row->size) {
+			int width;
+			i += editor_row_char(row, i, render_x, &width);
+			render_x += width;
+		}
+		if (i < next) {
+			break;
+		}
+
+		if (row->checkpoint_count == row->checkpoint_capacity) {
+			row->checkpoint_capacity *= 2;
+			row->checkpoints =
+				realloc(row->checkpoints, sizeof(editor_checkpoint_t) *
+											  row->checkpoint_capacity);
+		}
+		row->checkpoints[row->checkpoint_count].at = i;
+		row->checkpoints[row->checkpoint_count].rx = render_x;
+		row->checkpoint_count++;
+	}
+
+	// checkpoint k starts within a character of byte k * ROW_CHECKPOINT
+	int lo = 0, hi = at / ROW_CHECKPOINT;
+	if (hi >= row->checkpoint_count) {
+		hi = row->checkpoint_count - 1;
+	}
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (row->checkpoints[mid].at > at || row->checkpoints[mid].rx > rx) {
+			hi = mid - 1;
+		} else {
+			lo = mid;
+		}
+	}
+
+	return &row->checkpoints[lo];
+}
+
+/**
+ * @brief	This routine inserts a string into a row.
+ */
+void editor_row_insert(editor_row_t *row, int at, const char *s, int len)
+{
+	undo_insert_text(row, at, s, len);
+
+	editor_row_own(row);
+	editor_row_reserve(row, len);
+	editor_row_move_gap(row, at);
+	memcpy(&row->buf[row->gap], s, len);
+	row->gap += len;
+	row->gap_len -= len;
+	row->size += len;
+	editor_row_forget_columns(row, at);
+	highlight_edited(row, at, 0, len);
+	editor_update_row(row);
+}
+
+/**
+ * @brief	This routine removes a range of bytes from a row.
+ */
+void editor_row_delete(editor_row_t *row, int at, int len)
+{
+	editor_row_own(row);
+	editor_row_move_gap(row, at);
+	undo_remove_text(row, at, &row->buf[row->gap + row->gap_len], len);
+
+	row->gap_len += len;
+	row->size -= len;
+	editor_row_forget_columns(row, at);
+	highlight_edited(row, at, len, 0);
+	editor_update_row(row);
+}
+
+/**
+ * @brief	This routine takes storage for a row from the slabs.
+ */
+static editor_row_t *editor_slab_alloc()
+{
+	editor_slab_cell_t *cell = slab_free;
+	if (cell) {
+		slab_free = cell->next;
+		return &cell->row;
+	}
+
+	if (slab_left == 0) {
+		slab_next = malloc(sizeof(editor_slab_cell_t) * ROW_SLAB_ROWS);
+		slab_left = ROW_SLAB_ROWS;
+	}
+	slab_left--;
+	return &(slab_next++)->row;
+}
+
+/**
+ * @brief	This routine gives the storage of a row back to the slabs.
+ */
+static void editor_slab_free(editor_row_t *row)
+{
+	editor_slab_cell_t *cell = (editor_slab_cell_t *)row;
+	cell->next = slab_free;
+	slab_free = cell;
+}
+
+/**
+ * @brief	This routine allocates a row around the specified buffer.
+ * 			The render buffer is built once the row is drawn.
+ */
+editor_row_t *editor_new_row(char *buf, int len, int flags)
+{
+	editor_row_t *row = editor_slab_alloc();
+	row->size = len;
+	row->render_size = 0;
+	row->buf = buf;
+	row->render = NULL;
+	row->hl = NULL;
+	row->checkpoints = NULL;
+	row->checkpoint_count = 0;
+	row->checkpoint_capacity = 0;
+	row->hl_checkpoints = NULL;
+	row->hl_checkpoint_count = 0;
+	row->hl_checkpoint_capacity = 0;
+	row->hl_checkpoint_valid = 0;
+	row->flags = flags | ROW_RENDER_DIRTY;
+	row->render_col = 0;
+	row->render_cols = 0;
+	row->gap = len;
+	row->gap_len = 0;
+	row->render_slot = -1;
+	row->render_frame = 0;
+	row->snapshot = 0;
+	row->leaf = NULL;
+	return row;
+}
+
+/**
+ * @brief	This routine returns the specified row. Rows backed by
+ * 			the file mapping are materialized on first access.
+ */
+editor_row_t *editor_get_row(int at)
+{
+	int first;
+	document_node_t *leaf = document_find_leaf(at, &first);
+	editor_row_t **rows = document_leaf_rows(leaf);
+	int pos = at - first;
+	if (rows[pos] == NULL) {
+		int len;
+		const char *s = editor_row_text(at, &len);
+		document_set_row(leaf, pos, editor_new_row((char *)s, len, ROW_MAPPED));
+	}
+	document_touch(leaf);
+
+	return rows[pos];
+}
+
+/**
+ * @brief	This routine returns the contents of the specified row
+ * 			without materializing it. The returned buffer
+ * 			is not necessarily null-terminated.
+ *
+ * @return	Pointer to the row contents
+ */
+const char *editor_row_text(int at, int *len)
+{
+	int first;
+	document_node_t *leaf = document_find_leaf(at, &first);
+	int pos = at - first;
+	editor_row_t *row = leaf->materialized ? leaf->materialized[pos] : NULL;
+	if (row) {
+		editor_row_close_gap(row);
+		*len = row->size;
+		return row->buf;
+	}
+
+	*len = leaf->sizes[pos];
+	return roku_config.file_map + leaf->offsets[pos];
+}
+
+/**
+ * @brief	This routine gives the row a private copy of a buffer
+ * 			borrowed from the file mapping or shared with a save
+ * 			in progress, so it can be modified.
+ */
+void editor_row_own(editor_row_t *row)
+{
+	int shared = file_row_shared(row);
+	if (!(row->flags & ROW_MAPPED) && !shared) {
+		return;
+	}
+
+	char *buf = malloc(row->size + ROW_GAP_MIN + 1);
+	memcpy(buf, row->buf, row->size);
+	buf[row->size] = '\0';
+
+	if (shared && !(row->flags & ROW_MAPPED)) {
+		file_retire(row->buf);
+	}
+
+	row->buf = buf;
+	row->flags &= ~ROW_MAPPED;
+	row->snapshot = 0;
+	row->gap = row->size;
+	row->gap_len = ROW_GAP_MIN;
+}
+
+/**
+ * @brief	This routine replaces the contents of a row with a buffer
+ * 			of the specified length, which the row takes over.
+ */
+void editor_row_set_text(editor_row_t *row, char *buf, int len)
+{
+	editor_row_close_gap(row);
+	undo_remove_text(row, 0, row->buf, row->size);
+	undo_insert_text(row, 0, buf, len);
+
+	if (!(row->flags & ROW_MAPPED)) {
+		if (file_row_shared(row)) {
+			file_retire(row->buf);
+		} else {
+			free(row->buf);
+		}
+	}
+
+	highlight_edited(row, 0, row->size, len);
+	row->buf = buf;
+	row->size = len;
+	row->flags &= ~ROW_MAPPED;
+	row->snapshot = 0;
+	row->gap = len;
+	row->gap_len = 0;
+	editor_row_forget_columns(row, 0);
+	editor_update_row(row);
+}
+
+/**
+ * @brief	This routine makes sure the gap of a row
+ * 			can hold at least the specified number of bytes.
+ * 			The buffer grows geometrically.
+ */
+void editor_row_reserve(editor_row_t *row, int len)
+{
+	if (row->gap_len >= len) {
+		return;
+	}
+
+	int tail = row->size - row->gap;
+	int gap_len = row->size + len;
+	if (gap_len < ROW_GAP_MIN) {
+		gap_len = ROW_GAP_MIN;
+	}
+
+	row->buf = realloc(row->buf, row->size + gap_len + 1);
+	memmove(&row->buf[row->gap + gap_len], &row->buf[row->gap + row->gap_len],
+			tail);
+	row->gap_len = gap_len;
+}
+
+/**
+ * @brief	This routine moves the gap of a row to the specified index.
+ */
+void editor_row_move_gap(editor_row_t *row, int at)
+{
+	if (at < row->gap) {
+		memmove(&row->buf[at + row->gap_len], &row->buf[at], row->gap - at);
+	} else if (at > row->gap) {
+		memmove(&row->buf[row->gap], &row->buf[row->gap + row->gap_len],
+				at - row->gap);
+	}
+	row->gap = at;
+}
+
+/**
+ * @brief	This routine moves the gap of a row to its end, so the
+ * 			buffer holds the row contents as a null-terminated string.
+ */
+void editor_row_close_gap(editor_row_t *row)
+{
+	if (row->flags & ROW_MAPPED || row->gap == row->size) {
+		return;
+	}
+
+	editor_row_move_gap(row, row->size);
+	row->buf[row->size] = '\0';
+}
+
+/**
+ * @brief	This routine checks whether a row is plain ASCII without tabs,
+ * 			so that its bytes and columns are the same.
+ */
+int editor_row_plain(editor_row_t *row)
+{
+	if (row->render && !(row->flags & (ROW_RENDER_DIRTY | ROW_WINDOW))) {
+		return row->flags & ROW_PLAIN;
+	}
+
+	return utf8_is_plain(row->buf, row->gap) &&
+		   utf8_is_plain(&row->buf[row->gap + row->gap_len],
+						 row->size - row->gap);
+}
+
+/**
+ * @brief	This routine decodes the character of a row at the specified
+ * 			index, which is rendered at column rx.
+ *
+ * @return	Length of the character in bytes, its width is stored in width
+ */
+int editor_row_char(editor_row_t *row, int at, int rx, int *width)
+{
+	char s[4];
+	int len = row->size - at < 4 ? row->size - at : 4;
+	for (int i = 0; i < len; i++) {
+		s[i] = ROW_CHAR(row, at + i);
+	}
+
+	if (s[0] == '\t') {
+		*width = TAB_WIDTH - rx % TAB_WIDTH;
+		return 1;
+	}
+
+	int cp;
+	int n = utf8_decode(s, len, &cp);
+	*width = cp == -1 ? 1 : utf8_width(cp);
+	return n;
+}
+
+/**
+ * @brief	This routine returns the index of the character following
+ * 			the one at the specified index. Combining marks are skipped.
+ */
+int editor_row_next(editor_row_t *row, int at)
+{
+	int width;
+	at += editor_row_char(row, at, 0, &width);
+
+	while (at < row->size) {
+		int n = editor_row_char(row, at, 0, &width);
+		if (width != 0) {
+			break;
+		}
+		at += n;
+	}
+
+	return at;
+}
+
+/**
+ * @brief	This routine returns the index of the character before
+ * 			the specified index. Combining marks are skipped.
+ */
+int editor_row_prev(editor_row_t *row, int at)
+{
+	int width;
+
+	do {
+		int start = at - 1;
+		while (start > 0 && at - start < 4 &&
+			   UTF8_IS_CONT(ROW_CHAR(row, start))) {
+			start--;
+		}
+
+		// stray continuation bytes are characters of their own
+		if (start + editor_row_char(row, start, 0, &width) != at) {
+			start = at - 1;
+			editor_row_char(row, start, 0, &width);
+		}
+		at = start;
+	} while (at > 0 && width == 0);
+
+	return at;
+}
+
+/**
+ * @brief	This routine finds the first character of a row rendered
+ * 			in a window starting at the specified column. A tab or
+ * 			wide character cut off by the window is skipped and leaves
+ * 			pad columns blank, the marks of a wide character go with it.
+ *
+ * @return	Index of the character, its column is stored in col
+ */
+int editor_row_window(editor_row_t *row, int first, int *col, int *pad)
+{
+	int at = editor_row_rx_to_cur_x(row, first);
+	*col = editor_row_cur_x_to_rx(row, at);
+	*pad = 0;
+
+	if (at < row->size && *col < first) {
+		int width;
+		int tab = ROW_CHAR(row, at) == '\t';
+		at += editor_row_char(row, at, *col, &width);
+		*pad = *col + width - first;
+		*col += width;
+
+		// marks following a tab go on the last of its blanks
+		while (at < row->size && !tab) {
+			int n = editor_row_char(row, at, *col, &width);
+			if (width != 0) {
+				break;
+			}
+			at += n;
+		}
+	}
+
+	return at;
+}
+
 /**
  * @brief	This routine appends a row to the render buffer
  */
-void editor_append_row(int at, char *s, size_t len)
+void editor_append_row(int at, const char *s, size_t len)
 {
 	if (at < 0 || at > roku_config.num_rows) {
 		return;
 	}
 
-	roku_config.row = realloc(roku_config.row, sizeof(editor_row_t) *
-												   (roku_config.num_rows + 1));
-	memmove(&roku_config.row[at + 1], &roku_config.row[at],
-			sizeof(editor_row_t) * (roku_config.num_rows - at));
-
-	roku_config.row[at].size = len;
-	roku_config.row[at].buf = malloc(len + 1);
+	char *buf = malloc(len + 1);
 
-	memcpy(roku_config.row[at].buf, s, len);
+	memcpy(buf, s, len);
 
-	roku_config.row[at].buf[len] = '\0';
+	buf[len] = '\0';
 
-	roku_config.row[at].render_size = 0;
-	roku_config.row[at].render = NULL;
+	undo_insert_row(at, s, len);
 
-	editor_update_row(&roku_config.row[at]);
+	editor_row_t *row = editor_new_row(buf, len, 0);
+	document_insert(at, row, 0, len);
+	file_load_moved(at, 1);
+	highlight_inserted(at);
 
-	roku_config.num_rows++;
 	roku_config.file_dirty++;
 }
 
 /**
  * @brief	This routine appends a string to the specified row.
  */
-void editor_row_append_string(editor_row_t *row, char *s, size_t len)
+void editor_row_append_string(editor_row_t *row, const char *s,
+							  size_t len)
 {
-	row->buf = realloc(row->buf, row->size + len + 1);
-	memcpy(&row->buf[row->size], s, len);
-	row->size += len;
-	row->buf[row->size] = '\0';
-	editor_update_row(row);
+	editor_row_insert(row, row->size, s, len);
 	roku_config.file_dirty++;
 }
 
@@ -393,8 +1193,22 @@ void editor_row_append_string(editor_row_t *row, char *s, size_t len)
  */
 void editor_free_row(editor_row_t *row)
 {
-	free(row->render);
-	free(row->buf);
+	editor_drop_render(row);
+	free(row->checkpoints);
+	row->checkpoints = NULL;
+	row->checkpoint_count = 0;
+	free(row->hl_checkpoints);
+	row->hl_checkpoints = NULL;
+	row->hl_checkpoint_count = 0;
+	if (row->flags & ROW_MAPPED) {
+		return;
+	}
+
+	if (file_row_shared(row)) {
+		file_retire(row->buf);
+	} else {
+		free(row->buf);
+	}
 }
 
 /**
@@ -406,43 +1220,263 @@ void editor_remove_row(int at)
 		return;
 	}
 
-	editor_free_row(&roku_config.row[at]);
-	memmove(&roku_config.row[at], &roku_config.row[at + 1],
-			sizeof(editor_row_t) * (roku_config.num_rows - at - 1));
-	roku_config.num_rows--;
+	int len;
+	const char *text = editor_row_text(at, &len);
+	undo_remove_row(at, text, len);
+
+	editor_row_t *row = document_row(at);
+	document_remove(at);
+	file_load_moved(at, -1);
+	highlight_removed(at);
+	if (row) {
+		editor_free_row(row);
+		editor_slab_free(row);
+	}
 	roku_config.file_dirty++;
 }
 
 /**
- * @brief	This routine updates the render buffer of a row.
+ * @brief	This routine marks the render buffer of a row as out of date.
+ * 			It is rebuilt once the row is drawn.
  */
 void editor_update_row(editor_row_t *row)
 {
-	int tabs = 0;
-	int i;
+	row->flags |= ROW_RENDER_DIRTY;
+	document_update_size(row);
+	highlight_changed(row);
+	roku_config.edits++;
+}
+
+/**
+ * @brief	This routine renders the columns of a long row that fit
+ * 			in the window, so the cost doesn't depend on the length
+ * 			of the row. The buffer is read around the gap.
+ *
+ * @return	Size of the render buffer
+ */
+static int editor_render_window(editor_row_t *row)
+{
+	int first = roku_config.col_off;
+	int last = first + roku_config.window_size.cols;
+	int capacity = roku_config.window_size.cols * 4 + TAB_WIDTH + 1;
+	row->render = malloc(capacity);
+
+	int col, pad;
+	int i = editor_row_window(row, first, &col, &pad);
+	memset(row->render, ' ', pad);
+	int idx = pad;
+
+	while (i < row->size) {
+		int width;
+		int n = editor_row_char(row, i, col, &width);
+		if (col >= last && width != 0) {
+			break;
+		}
+
+		// combining marks may pile up past the estimate
+		if (idx + n + TAB_WIDTH >= capacity) {
+			capacity *= 2;
+			row->render = realloc(row->render, capacity);
+		}
+
+		char c = ROW_CHAR(row, i);
+		if (c == '\t') {
+			memset(&row->render[idx], ' ', width);
+			idx += width;
+		} else if (n == 1 && (unsigned char)c >= 0x80) {
+			row->render[idx++] = UTF8_INVALID;
+		} else {
+			for (int k = 0; k < n; k++) {
+				row->render[idx++] = ROW_CHAR(row, i + k);
+			}
+		}
+		col += width;
+		i += n;
+	}
+
+	row->flags |= ROW_WINDOW;
+	row->flags &= ~ROW_PLAIN;
+	row->render_col = first;
+	row->render_cols = roku_config.window_size.cols;
+	return idx;
+}
 
-	for (i = 0; i < row->size; i++) {
-		if (row->buf[i] == '\t')
-			tabs++;
+/**
+ * @brief	This routine rebuilds the render buffer of a row
+ * 			if it is missing or out of date.
+ */
+void editor_render_row(editor_row_t *row)
+{
+	if (row->render && !(row->flags & ROW_RENDER_DIRTY) &&
+		(!(row->flags & ROW_WINDOW) ||
+		 (row->render_col == roku_config.col_off &&
+		  row->render_cols == roku_config.window_size.cols))) {
+		return;
 	}
 
 	free(row->render);
-	row->render = malloc(row->size + tabs * (TAB_WIDTH - 1) + 1);
+	free(row->hl);
+	row->hl = NULL;
+	row->flags &= ~ROW_WINDOW;
 
 	int idx = 0;
-	for (i = 0; i < row->size; i++) {
-		if (row->buf[i] == '\t') {
-			row->render[idx++] = ' ';
-			while (idx % TAB_WIDTH != 0) {
-				row->render[idx++] = ' ';
+	if (row->size > ROW_RENDER_MAX) {
+		idx = editor_render_window(row);
+	} else if (editor_row_plain(row)) {
+		// most rows are copied as they are, without looking at the bytes
+		int tail = row->size - row->gap;
+		row->render = malloc(row->size + 1);
+		memcpy(row->render, row->buf, row->gap);
+		memcpy(&row->render[row->gap], &row->buf[row->gap + row->gap_len],
+			   tail);
+		idx = row->size;
+		row->flags |= ROW_PLAIN;
+	} else {
+		editor_row_close_gap(row);
+
+		int tabs = 0;
+		for (int i = 0; i < row->size; i++) {
+			if (row->buf[i] == '\t')
+				tabs++;
+		}
+		row->render = malloc(row->size + tabs * (TAB_WIDTH - 1) + 1);
+
+		int col = 0;
+		for (int i = 0; i < row->size;) {
+			if (row->buf[i] == '\t') {
+				do {
+					row->render[idx++] = ' ';
+					col++;
+				} while (col % TAB_WIDTH != 0);
+				i++;
+				continue;
 			}
-		} else {
-			row->render[idx++] = row->buf[i];
+
+			int cp;
+			int n = utf8_decode(&row->buf[i], row->size - i, &cp);
+			if (cp == -1) {
+				row->render[idx++] = UTF8_INVALID;
+				col++;
+			} else {
+				memcpy(&row->render[idx], &row->buf[i], n);
+				idx += n;
+				col += utf8_width(cp);
+			}
+			i += n;
 		}
+		row->flags &= ~ROW_PLAIN;
 	}
 
 	row->render[idx] = '\0';
 	row->render_size = idx;
+	row->flags &= ~ROW_RENDER_DIRTY;
+
+	if (row->render_slot == -1) {
+		if (render_count == render_capacity) {
+			render_capacity = render_capacity ? render_capacity * 2 : 64;
+			render_rows =
+				realloc(render_rows, sizeof(editor_row_t *) * render_capacity);
+		}
+		row->render_slot = render_count;
+		render_rows[render_count++] = row;
+	}
+}
+
+/**
+ * @brief	This routine frees the render buffer of a row.
+ */
+void editor_drop_render(editor_row_t *row)
+{
+	if (row->render_slot == -1) {
+		return;
+	}
+
+	free(row->render);
+	free(row->hl);
+	row->render = NULL;
+	row->hl = NULL;
+	row->render_size = 0;
+
+	editor_row_t *last = render_rows[--render_count];
+	last->render_slot = row->render_slot;
+	render_rows[row->render_slot] = last;
+	row->render_slot = -1;
+}
+
+/**
+ * @brief	This routine frees the render buffers of rows that
+ * 			weren't drawn in the last frame, once there are
+ * 			more of them than a few screens worth.
+ */
+void editor_evict_renders()
+{
+	if (render_count <= roku_config.window_size.rows * RENDER_KEEP_SCREENS) {
+		return;
+	}
+
+	int i = 0;
+	while (i < render_count) {
+		if (render_rows[i]->render_frame != render_frame) {
+			// the last row is moved into this slot
+			editor_drop_render(render_rows[i]);
+		} else {
+			i++;
+		}
+	}
+}
+
+/**
+ * @brief	This routine releases the unmodified rows of the least recently
+ * 			used leaves once too many leaves hold materialized rows.
+ * 			They are materialized from the file mapping again when needed.
+ */
+void editor_evict_rows()
+{
+	document_node_t *leaf;
+	while ((leaf = document_cold_leaf()) != NULL) {
+		// rows backed by the file mapping are in file order
+		int first = -1, last = -1;
+		int kept = 0;
+
+		for (int i = 0; i < leaf->count && leaf->materialized; i++) {
+			editor_row_t *row = leaf->materialized[i];
+			if (row && !(row->flags & ROW_MAPPED)) {
+				kept++;
+				continue;
+			}
+
+			if (row) {
+				editor_free_row(row);
+				editor_slab_free(row);
+				leaf->materialized[i] = NULL;
+			}
+
+			if (first == -1) {
+				first = i;
+			}
+			last = i;
+		}
+
+		// leaves without modified rows don't need the array any more
+		if (kept == 0) {
+			free(leaf->materialized);
+			leaf->materialized = NULL;
+		}
+		if (first == -1 || roku_config.file_map_owned) {
+			continue;
+		}
+
+		// pages of the file are read again as well, so that scrolling
+		// through a file doesn't keep all of it mapped in
+		size_t lo = leaf->offsets[first];
+		size_t hi = leaf->offsets[last] + leaf->sizes[last];
+		long page = sysconf(_SC_PAGESIZE);
+		size_t start = (lo + page - 1) / page * page;
+		size_t end = hi / page * page;
+		if (start < end) {
+			madvise(roku_config.file_map + start, end - start, MADV_DONTNEED);
+		}
+	}
 }
 
 /**
@@ -453,13 +1487,14 @@ void editor_insert_newline()
 	if (roku_config.cur_x == 0) {
 		editor_append_row(roku_config.cur_y, "", 0);
 	} else {
-		editor_row_t *row = &roku_config.row[roku_config.cur_y];
-		editor_append_row(roku_config.cur_y + 1, &row->buf[roku_config.cur_x],
-						  row->size - roku_config.cur_x);
-		row = &roku_config.row[roku_config.cur_y];
-		row->size = roku_config.cur_x;
-		row->buf[row->size] = '\0';
-		editor_update_row(row);
+		editor_row_t *row = editor_get_row(roku_config.cur_y);
+		editor_row_own(row);
+		editor_row_move_gap(row, roku_config.cur_x);
+
+		int tail = row->size - roku_config.cur_x;
+		editor_append_row(roku_config.cur_y + 1,
+						  &row->buf[row->gap + row->gap_len], tail);
+		editor_row_delete(row, roku_config.cur_x, tail);
 	}
 	roku_config.cur_y++;
 	roku_config.cur_x = 0;
@@ -470,27 +1505,18 @@ void editor_insert_newline()
  */
 void editor_refresh_screen()
 {
-	struct append_buf buf = APPEND_BUF_INIT;
-
 	editor_handle_scrolling();
 
-	editor_buffer_append(&buf, "\x1b[?25l", 6);
-	editor_buffer_append(&buf, "\x1b[H", 3);
+	screen_clear();
+	editor_draw_row();
+	editor_draw_statusbar();
+	editor_draw_messagebar();
 
-	editor_draw_row(&buf);
-	editor_draw_statusbar(&buf);
-	editor_draw_messagebar(&buf);
+	screen_flush(&frame_buf, roku_config.cur_y - roku_config.row_off,
+				 roku_config.render_x - roku_config.col_off);
 
-	char buffer[32];
-	snprintf(buffer, sizeof(buffer), "\x1b[%d;%dH",
-			 (roku_config.cur_y - roku_config.row_off) + 1,
-			 (roku_config.render_x - roku_config.col_off) + 1);
-	editor_buffer_append(&buf, buffer, strlen(buffer));
-
-	editor_buffer_append(&buf, "\x1b[?25h", 6);
-
-	write(STDOUT_FILENO, buf.buffer, buf.size);
-	editor_buffer_free(&buf);
+	roku_config.output->write(frame_buf.buffer, frame_buf.size);
+	editor_buffer_reset(&frame_buf);
 }
 
 /**
@@ -502,7 +1528,7 @@ void editor_handle_scrolling()
 	roku_config.render_x = roku_config.cur_x;
 	if (roku_config.cur_y < roku_config.num_rows) {
 		roku_config.render_x = editor_row_cur_x_to_rx(
-			&roku_config.row[roku_config.cur_y], roku_config.cur_x);
+			editor_get_row(roku_config.cur_y), roku_config.cur_x);
 	}
 
 	if (roku_config.cur_y < roku_config.row_off) {
@@ -531,12 +1557,20 @@ void editor_handle_scrolling()
 int editor_row_cur_x_to_rx(editor_row_t *row, int cur_x)
 {
 	int render_x = 0;
+	int i = 0;
+
+	if (row->size > ROW_CHECKPOINT) {
+		editor_checkpoint_t *cp = editor_row_checkpoint(row, cur_x, INT_MAX);
+		i = cp->at;
+		render_x = cp->rx;
+	} else if (editor_row_plain(row)) {
+		return cur_x;
+	}
 
-	for (int i = 0; i < cur_x; i++) {
-		if (row->buf[i] == '\t') {
-			render_x += (TAB_WIDTH - 1) - (render_x % TAB_WIDTH);
-		}
-		render_x++;
+	while (i < cur_x) {
+		int width;
+		i += editor_row_char(row, i, render_x, &width);
+		render_x += width;
 	}
 	return render_x;
 }
@@ -549,17 +1583,25 @@ int editor_row_cur_x_to_rx(editor_row_t *row, int cur_x)
 int editor_row_rx_to_cur_x(editor_row_t *row, int rx)
 {
 	int render_x = 0;
-	int cur_x;
+	int cur_x = 0;
+
+	if (row->size > ROW_CHECKPOINT) {
+		editor_checkpoint_t *cp = editor_row_checkpoint(row, row->size, rx);
+		cur_x = cp->at;
+		render_x = cp->rx;
+	} else if (editor_row_plain(row)) {
+		return rx < row->size ? rx : row->size;
+	}
 
-	for (cur_x = 0; cur_x < row->size; cur_x++) {
-		if (row->buf[cur_x] == '\t') {
-			render_x += (TAB_WIDTH - 1) - (render_x % TAB_WIDTH);
-		}
-		render_x++;
+	while (cur_x < row->size) {
+		int width;
+		int n = editor_row_char(row, cur_x, render_x, &width);
+		render_x += width;
 
 		if (render_x > rx) {
 			return cur_x;
 		}
+		cur_x += n;
 	}
 
 	return cur_x;
@@ -570,19 +1612,53 @@ int editor_row_rx_to_cur_x(editor_row_t *row, int rx)
  */
 void editor_buffer_append(struct append_buf *buf, const char *s, int len)
 {
-	char *new = realloc(buf->buffer, buf->size + len);
+	if (buf->size + len > buf->capacity) {
+		int capacity = buf->capacity ? buf->capacity : APPEND_BUF_MIN;
+		while (capacity < buf->size + len) {
+			capacity *= 2;
+		}
 
-	if (new == NULL)
-		return;
-	memcpy(&new[buf->size], s, len);
-	buf->buffer = new;
+		char *new = realloc(buf->buffer, capacity);
+		if (new == NULL)
+			return;
+		buf->buffer = new;
+		buf->capacity = capacity;
+	}
+
+	memcpy(&buf->buffer[buf->size], s, len);
 	buf->size += len;
 }
 
+/**
+ * @brief	This routine empties the write buffer without freeing it
+ * 			and records the largest size it has reached.
+ */
+void editor_buffer_reset(struct append_buf *buf)
+{
+	if (buf->size > buf->peak) {
+		buf->peak = buf->size;
+	}
+	buf->size = 0;
+}
+
 /**
  * @brief	This routine frees the write buffer.
  */
 void editor_buffer_free(struct append_buf *buf)
 {
 	free(buf->buffer);
+	buf->buffer = NULL;
+	buf->size = 0;
+	buf->capacity = 0;
+}
+
+/**
+ * @brief	This routine returns the size of the largest frame
+ * 			written so far.
+ *
+ * @return	Peak frame size in bytes
+ */
+int editor_frame_peak()
+{
+	return frame_buf.peak;
 }
@@ -11,14 +11,20 @@
 
 #include "roku.h"
 
-#define APPEND_BUF_INIT {NULL, 0}
+#define APPEND_BUF_INIT {NULL, 0, 0, 0}
+
+// initial capacity of a write buffer
+#define APPEND_BUF_MIN 4096
 
 /**
- * @brief	Write buffer
+ * @brief	Write buffer. The allocation is kept when the buffer
+ * 			is reset, so it can be reused for every frame.
  */
 struct append_buf {
 	char *buffer;
 	int size;
+	int capacity;
+	int peak;
 };
 
 /**
@@ -26,24 +32,26 @@ struct append_buf {
  * 			If a row hasn't been specified to be drawn,
  * 			the first character of it is replaced by a tilde (~).
  */
-void editor_draw_row(struct append_buf *buf);
+void editor_draw_row();
 
 /**
  * @brief	This routine draws a status bar at the bottom of the terminal window
  */
-void editor_draw_statusbar(struct append_buf *buf);
+void editor_draw_statusbar();
 
 /**
  * @brief	This routine draws a message bar below the status bar
  */
-void editor_draw_messagebar(struct append_buf *buf);
+void editor_draw_messagebar();
 
 /**
  * @brief	This routine displays a prompt in the message bar.
+ * 			Empty input is only accepted if allow_empty is set.
  * 
  * @return	User's input.
  */
-char *editor_display_prompt(char *prompt, void *(callback)(char *, int));
+char *editor_display_prompt(char *prompt, void *(callback)(char *, int),
+							int allow_empty);
 
 /**
  * @brief	Sets the status message to be shown on the status bar.
@@ -56,23 +64,69 @@ void editor_set_status(const char *fmt, ...);
  */
 void editor_move_curpos(int key);
 
+/**
+ * @brief	This routine moves the cursor a screen up or down.
+ */
+void editor_move_page(int key);
+
+/**
+ * @brief	This routine moves the cursor to the start of a line.
+ * 			Lines are numbered from 1.
+ */
+void editor_goto_line(int line);
+
+/**
+ * @brief	This routine moves the cursor to a byte offset,
+ * 			counting a newline after every line.
+ */
+void editor_goto_byte(size_t offset);
+
+/**
+ * @brief	This routine asks for a line, or for a byte offset
+ * 			prefixed with '@', and moves the cursor there.
+ */
+void editor_goto();
+
 /**
  * @brief	This routine initializes the editor interface
  */
 void editor_init();
 
+/**
+ * @brief	This routine fetches the terminal window size
+ * 			and resizes the screen to fit it.
+ *
+ * @return	status code
+ */
+int editor_update_window_size();
+
+/**
+ * @brief	This routine returns the time left until the status
+ * 			message has to be cleared from the screen.
+ *
+ * @return	Timeout in milliseconds, -1 if there is nothing to clear
+ */
+int editor_status_timeout();
+
 /**
  * @brief	This routine inserts a character into the current row.
 */
 void editor_insert_char(int c);
 
+/**
+ * @brief	This routine inserts a block of text at the cursor,
+ * 			splitting it into rows in a single pass.
+ */
+void editor_insert_text(const char *s, int len);
+
 /**
  * @brief	This routine deletes a character from the current row
  */
 void editor_remove_char();
 
 /**
- * @brief	This routine removes a character from the current row buffer.
+ * @brief	This routine removes a character from the current row buffer,
+ * 			along with the combining marks following it.
  */
 void editor_remove_from_row(editor_row_t *row, int at);
 
@@ -81,15 +135,114 @@ void editor_remove_from_row(editor_row_t *row, int at);
  */
 void editor_insert_into_row(editor_row_t *row, int at, int c);
 
+/**
+ * @brief	This routine inserts a string into a row.
+ */
+void editor_row_insert(editor_row_t *row, int at, const char *s, int len);
+
+/**
+ * @brief	This routine removes a range of bytes from a row.
+ */
+void editor_row_delete(editor_row_t *row, int at, int len);
+
+/**
+ * @brief	This routine allocates a row around the specified buffer.
+ * 			The render buffer is built once the row is drawn.
+ */
+editor_row_t *editor_new_row(char *buf, int len, int flags);
+
+/**
+ * @brief	This routine returns the specified row. Rows backed by
+ * 			the file mapping are materialized on first access.
+ */
+editor_row_t *editor_get_row(int at);
+
+/**
+ * @brief	This routine returns the contents of the specified row
+ * 			without materializing it. The returned buffer
+ * 			is not necessarily null-terminated.
+ *
+ * @return	Pointer to the row contents
+ */
+const char *editor_row_text(int at, int *len);
+
+/**
+ * @brief	This routine gives the row a private copy of a buffer
+ * 			borrowed from the file mapping or shared with a save
+ * 			in progress, so it can be modified.
+ */
+void editor_row_own(editor_row_t *row);
+
+/**
+ * @brief	This routine replaces the contents of a row with a buffer
+ * 			of the specified length, which the row takes over.
+ */
+void editor_row_set_text(editor_row_t *row, char *buf, int len);
+
+/**
+ * @brief	This routine makes sure the gap of a row
+ * 			can hold at least the specified number of bytes.
+ * 			The buffer grows geometrically.
+ */
+void editor_row_reserve(editor_row_t *row, int len);
+
+/**
+ * @brief	This routine moves the gap of a row to the specified index.
+ */
+void editor_row_move_gap(editor_row_t *row, int at);
+
+/**
+ * @brief	This routine moves the gap of a row to its end, so the
+ * 			buffer holds the row contents as a null-terminated string.
+ */
+void editor_row_close_gap(editor_row_t *row);
+
+/**
+ * @brief	This routine checks whether a row is plain ASCII without tabs,
+ * 			so that its bytes and columns are the same.
+ */
+int editor_row_plain(editor_row_t *row);
+
+/**
+ * @brief	This routine decodes the character of a row at the specified
+ * 			index, which is rendered at column rx.
+ *
+ * @return	Length of the character in bytes, its width is stored in width
+ */
+int editor_row_char(editor_row_t *row, int at, int rx, int *width);
+
+/**
+ * @brief	This routine returns the index of the character following
+ * 			the one at the specified index. Combining marks are skipped.
+ */
+int editor_row_next(editor_row_t *row, int at);
+
+/**
+ * @brief	This routine returns the index of the character before
+ * 			the specified index. Combining marks are skipped.
+ */
+int editor_row_prev(editor_row_t *row, int at);
+
+/**
+ * @brief	This routine finds the first character of a row rendered
+ * 			in a window starting at the specified column. A tab or
+ * 			wide character cut off by the window is skipped and leaves
+ * 			pad columns blank, the marks of a wide character go with it.
+ *
+ * @return	Index of the character, its column is stored in col
+ */
+int editor_row_window(editor_row_t *row, int first, int *col, int *pad);
+
 /**
  * @brief	This routine appends a row to the render buffer
  */
-void editor_append_row(int at, char *s, size_t len);
+void editor_append_row(int at, const char *s, size_t len);
 
 /**
  * @brief	This routine appends a string to the specified row.
  */
-void editor_row_append_string(editor_row_t *row, char *s, size_t len);
+void editor_row_append_string(editor_row_t *row, const char *s,
+							  size_t len);
 
 /**
  * @brief	This routine frees the row buffer
@@ -102,10 +255,36 @@ void editor_free_row(editor_row_t *row);
 void editor_remove_row(int at);
 
 /**
- * @brief	This routine updates the render buffer of a row.
+ * @brief	This routine marks the render buffer of a row as out of date.
+ * 			It is rebuilt once the row is drawn.
  */
 void editor_update_row(editor_row_t *row);
 
+/**
+ * @brief	This routine rebuilds the render buffer of a row
+ * 			if it is missing or out of date.
+ */
+void editor_render_row(editor_row_t *row);
+
+/**
+ * @brief	This routine frees the render buffer of a row.
+ */
+void editor_drop_render(editor_row_t *row);
+
+/**
+ * @brief	This routine frees the render buffers of rows that
+ * 			weren't drawn in the last frame, once there are
+ * 			more of them than a few screens worth.
+ */
+void editor_evict_renders();
+
+/**
+ * @brief	This routine releases the unmodified rows of the least recently
+ * 			used leaves once too many leaves hold materialized rows.
+ * 			They are materialized from the file mapping again when needed.
+ */
+void editor_evict_rows();
+
 /**
  * @brief	This routine inserts a newline
  */
@@ -141,9 +320,23 @@ int editor_row_rx_to_cur_x(editor_row_t *row, int rx);
  */
 void editor_buffer_append(struct append_buf *buf, const char *s, int len);
 
+/**
+ * @brief	This routine empties the write buffer without freeing it
+ * 			and records the largest size it has reached.
+ */
+void editor_buffer_reset(struct append_buf *buf);
+
 /**
  * @brief	This routine frees the write buffer.
  */
 void editor_buffer_free(struct append_buf *buf);
 
+/**
+ * @brief	This routine returns the size of the largest frame
+ * 			written so far.
+ *
+ * @return	Peak frame size in bytes
+ */
+int editor_frame_peak();
+
 #endif // __EDITOR_H_
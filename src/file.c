@@ -6,8 +6,12 @@
  */
 
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -16,6 +20,64 @@
 #include "file.h"
 #include "roku.h"
 #include "editor.h"
+#include "document.h"
+#include "config.h"
+#include "highlight.h"
+#include "terminal.h"
+#include "undo.h"
+
+// state of the save running in the background
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int active;
+	int done;
+	int error;
+	// the file was replaced, but the rename may not be on disk yet
+	int sync_error;
+	unsigned int id;
+	// resolved target and the temporary file replacing it,
+	// NULL if the target is written in place
+	char *filename;
+	char *tmp;
+	int fd;
+	mode_t mode;
+	// position of the undo history the snapshot was taken at
+	long position;
+	file_extent_t *extents;
+	int count;
+	int capacity;
+	size_t total;
+	size_t written;
+	char **retired;
+	int retired_count;
+	int retired_capacity;
+} save = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// state of the file being indexed in the background
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int active;
+	int done;
+	int joined;
+	size_t scanned;
+	// lines indexed but not added to the document yet
+	file_line_t *lines;
+	int count;
+	int capacity;
+	file_line_t *spare;
+	int spare_capacity;
+	// where the next line goes
+	int row;
+} load = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void *file_load_thread(void *arg);
+static void file_load_publish(const file_line_t *batch, int count,
+							  size_t scanned, int done);
+static void file_save_snapshot();
+static void file_save_finish(int join);
+static void *file_save_thread(void *arg);
 
 /**
  * @brief	This routine opens the specified file
@@ -25,12 +87,21 @@ void file_open(char *filename)
 {
 	free(roku_config.filename);
 	roku_config.filename = strdup(filename);
+	highlight_select(filename);
+
+	if (file_map(filename) == 0) {
+		roku_config.file_dirty = 0;
+		return;
+	}
 
 	FILE *fp = fopen(filename, "r");
 	if (!fp) {
 		die("fopen: couldn't open file");
 	}
 
+	// loading the file is not a change that can be undone
+	undo_pause();
+
 	char *line = NULL;
 	size_t linecap = 0;
 	ssize_t length;
@@ -45,67 +116,707 @@ void file_open(char *filename)
 	free(line);
 	fclose(fp);
 
+	undo_resume();
+
 	roku_config.file_dirty = 0;
 }
 
 /**
- * @brief	Saves the buffer into a file.
+ * @brief	This routine maps the specified file into memory
+ * 			and starts building the line index in the background.
+ * 			Rows are not created until something touches them.
+ *
+ * @return	status code
+ */
+int file_map(char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return -1;
+	}
+
+	size_t size = st.st_size;
+	char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	roku_config.file_map = map;
+	roku_config.file_map_size = size;
+
+	load.row = roku_config.num_rows;
+	load.scanned = 0;
+	load.done = 0;
+	load.joined = 0;
+	load.active = 1;
+
+	if (pthread_create(&load.thread, NULL, file_load_thread, NULL) != 0) {
+		// index the file right away instead
+		file_load_thread(NULL);
+		load.joined = 1;
+		file_load_poll();
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	This routine builds the line index of the file mapping,
+ * 			handing the lines over to the main loop in batches.
+ */
+static void *file_load_thread(void *arg)
+{
+	(void)arg;
+
+	const char *map = roku_config.file_map;
+	size_t size = roku_config.file_map_size;
+
+	// the first batch fills the screen, later ones can be larger
+	int batch_size = FILE_LOAD_FIRST;
+	file_line_t *batch = malloc(sizeof(file_line_t) * FILE_LOAD_BATCH);
+	int count = 0;
+
+	// the whole file is read once, so don't let it all stay resident
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t released = 0;
+
+	size_t offset = 0;
+	while (offset < size) {
+		if (offset - released >= FILE_SCAN_RELEASE) {
+			size_t end = offset / page * page;
+			madvise((char *)map + released, end - released, MADV_DONTNEED);
+			released = end;
+		}
+
+		const char *newline = memchr(map + offset, '\n', size - offset);
+		size_t len = newline ? (size_t)(newline - map) - offset : size - offset;
+		while (len > 0 && map[offset + len - 1] == '\r') {
+			len--;
+		}
+
+		batch[count].offset = offset;
+		batch[count].len = len;
+		count++;
+
+		offset = newline ? (size_t)(newline - map) + 1 : size;
+		if (count == batch_size) {
+			file_load_publish(batch, count, offset, 0);
+			count = 0;
+			if (batch_size < FILE_LOAD_BATCH) {
+				batch_size *= 2;
+			}
+		}
+	}
+
+	file_load_publish(batch, count, size, 1);
+	free(batch);
+	return NULL;
+}
+
+/**
+ * @brief	This routine hands a batch of lines over to the main loop
+ * 			and wakes it up.
+ */
+static void file_load_publish(const file_line_t *batch, int count,
+							  size_t scanned, int done)
+{
+	pthread_mutex_lock(&load.lock);
+	if (load.count + count > load.capacity) {
+		while (load.count + count > load.capacity) {
+			load.capacity = load.capacity ? load.capacity * 2 : count;
+		}
+		load.lines = realloc(load.lines, sizeof(file_line_t) * load.capacity);
+	}
+	memcpy(load.lines + load.count, batch, sizeof(file_line_t) * count);
+	load.count += count;
+	load.scanned = scanned;
+	load.done = done;
+	pthread_mutex_unlock(&load.lock);
+
+	terminal_wake();
+}
+
+/**
+ * @brief	This routine adds the lines indexed so far to the document.
+ * 			Nothing is added while a search is reading the document.
+ */
+void file_load_poll()
+{
+	if (!load.active || document_held()) {
+		return;
+	}
+
+	// take the lines, the loader continues with the spare array
+	pthread_mutex_lock(&load.lock);
+	file_line_t *lines = load.lines;
+	int count = load.count;
+	int capacity = load.capacity;
+	load.lines = load.spare;
+	load.capacity = load.spare_capacity;
+	load.count = 0;
+	load.spare = lines;
+	load.spare_capacity = capacity;
+	int done = load.done;
+	pthread_mutex_unlock(&load.lock);
+
+	for (int i = 0; i < count; i++) {
+		document_insert(load.row++, NULL, lines[i].offset, lines[i].len);
+	}
+
+	if (done) {
+		if (!load.joined) {
+			pthread_join(load.thread, NULL);
+		}
+		free(load.lines);
+		free(load.spare);
+		load.lines = load.spare = NULL;
+		load.capacity = load.spare_capacity = 0;
+		load.active = 0;
+	}
+}
+
+/**
+ * @brief	This routine blocks until the whole file is loaded.
+ */
+void file_load_wait()
+{
+	if (!load.active) {
+		return;
+	}
+
+	if (!load.joined) {
+		pthread_join(load.thread, NULL);
+		load.joined = 1;
+	}
+
+	// a search holding the document would keep the lines back for good
+	while (load.active && !document_held()) {
+		file_load_poll();
+	}
+}
+
+/**
+ * @brief	This routine returns how far loading the file got.
+ *
+ * @return	Percentage of bytes indexed, -1 if the file is loaded
+ */
+int file_load_progress()
+{
+	if (!load.active) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&load.lock);
+	int percent = load.scanned * 100 / roku_config.file_map_size;
+	pthread_mutex_unlock(&load.lock);
+
+	return percent;
+}
+
+/**
+ * @brief	This routine keeps the rows still being loaded behind
+ * 			the rows that were inserted or removed in the meantime.
+ */
+void file_load_moved(int at, int delta)
+{
+	// a row inserted right after the loaded ones stays in front of the rest
+	if (load.active && (at < load.row || (at == load.row && delta > 0))) {
+		load.row += delta;
+	}
+}
+
+/**
+ * @brief	This routine replaces the file mapping with a private copy,
+ * 			so that rows borrowing from it survive the file being rewritten.
+ */
+static void file_detach_map()
+{
+	if (roku_config.file_map == NULL || roku_config.file_map_owned) {
+		return;
+	}
+
+	char *map = roku_config.file_map;
+	char *copy = malloc(roku_config.file_map_size);
+	memcpy(copy, map, roku_config.file_map_size);
+
+	for (int i = 0; i < roku_config.num_rows; i++) {
+		editor_row_t *row = document_row(i);
+		if (row && (row->flags & ROW_MAPPED)) {
+			row->buf = copy + (row->buf - map);
+		}
+	}
+
+	munmap(map, roku_config.file_map_size);
+	roku_config.file_map = copy;
+	roku_config.file_map_owned = 1;
+}
+
+/**
+ * @brief	This routine returns the directory of a path.
+ *
+ * @return	Newly allocated directory name
+ */
+static char *file_dirname(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	if (slash == NULL) {
+		return strdup(".");
+	}
+	if (slash == path) {
+		return strdup("/");
+	}
+
+	return strndup(path, slash - path);
+}
+
+/**
+ * @brief	This routine opens the file the snapshot is written into.
+ * 			It is a temporary file next to the target, with the same
+ * 			owner and permissions, unless the target has other hard
+ * 			links or no such file can be made. The target is then
+ * 			written in place and the mapping is detached from it first.
+ *
+ * @return	status code
+ */
+static int file_save_open()
+{
+	struct stat st;
+	int exists = stat(save.filename, &st) == 0;
+	if (exists) {
+		save.mode = st.st_mode & 07777;
+	} else {
+		save.mode = umask(0);
+		umask(save.mode);
+		save.mode = 0666 & ~save.mode;
+	}
+
+	save.tmp = NULL;
+	if (!exists || st.st_nlink == 1) {
+		size_t name_len = strlen(save.filename);
+		save.tmp = malloc(name_len + sizeof(".XXXXXX"));
+		memcpy(save.tmp, save.filename, name_len);
+		memcpy(save.tmp + name_len, ".XXXXXX", sizeof(".XXXXXX"));
+
+		// the owner goes first, changing it can clear the setuid bits
+		save.fd = mkstemp(save.tmp);
+		if (save.fd != -1) {
+			if ((!exists || fchown(save.fd, st.st_uid, st.st_gid) == 0) &&
+				fchmod(save.fd, save.mode) == 0) {
+				return 0;
+			}
+			close(save.fd);
+			unlink(save.tmp);
+		}
+		free(save.tmp);
+		save.tmp = NULL;
+	}
+
+	file_detach_map();
+	save.fd = open(save.filename, O_WRONLY | O_CREAT, save.mode);
+	return save.fd == -1 ? -1 : 0;
+}
+
+/**
+ * @brief	This routine flushes the directory entries of a file to disk.
+ *
+ * @return	status code
+ */
+static int file_sync_dir(const char *path)
+{
+	char *dir = file_dirname(path);
+	int fd = open(dir, O_RDONLY);
+	free(dir);
+	if (fd == -1) {
+		return -1;
+	}
+
+	int ret = fsync(fd);
+	close(fd);
+	return ret;
+}
+
+/**
+ * @brief	Saves the buffer into a file. The rows are captured
+ * 			in a snapshot that is written out in the background.
  */
 void file_save()
 {
+	if (save.active) {
+		editor_set_status("A save is already in progress");
+		return;
+	}
+
+	// the rest of the file has to be in the document to be written out
+	file_load_wait();
+
 	if (roku_config.filename == NULL) {
-		roku_config.filename = editor_display_prompt("Save as: %s", NULL);
+		roku_config.filename = editor_display_prompt("Save as: %s", NULL, 0);
 		if (roku_config.filename == NULL) {
 			editor_set_status("Aborted");
 			return;
 		}
+
+		// the name picks the syntax, the states of the rows are
+		// computed again from the top
+		highlight_select(roku_config.filename);
 	}
 
-	int len;
-	char *buf = file_rows_to_string(&len);
+	// a symbolic link is saved through, not replaced
+	save.filename = realpath(roku_config.filename, NULL);
+	if (save.filename == NULL) {
+		save.filename = strdup(roku_config.filename);
+	}
 
-	int fd = open(roku_config.filename, O_RDWR | O_CREAT, 0644);
-	if (fd != -1) {
-		if (ftruncate(fd, len) != -1) {
-			if (write(fd, buf, len) == len) {
-				close(fd);
-				free(buf);
-				roku_config.file_dirty = 0;
-				editor_set_status("%d bytes written", len);
-				return;
+	if (file_save_open() == -1) {
+		editor_set_status("An error occured while saving: %s",
+						  strerror(errno));
+		free(save.filename);
+		save.filename = NULL;
+		return;
+	}
+
+	save.id++;
+	save.active = 1;
+	file_save_snapshot();
+
+	save.position = undo_position();
+	save.written = 0;
+	save.done = 0;
+	save.error = 0;
+	save.sync_error = 0;
+
+	if (pthread_create(&save.thread, NULL, file_save_thread, NULL) != 0) {
+		// write the file right away instead
+		file_save_thread(NULL);
+		file_save_finish(0);
+	}
+}
+
+/**
+ * @brief	This routine finishes a save once the background
+ * 			thread is done with it.
+ */
+void file_save_poll()
+{
+	if (!save.active) {
+		return;
+	}
+
+	pthread_mutex_lock(&save.lock);
+	int done = save.done;
+	pthread_mutex_unlock(&save.lock);
+
+	if (done) {
+		file_save_finish(1);
+	}
+}
+
+/**
+ * @brief	This routine blocks until the running save is finished.
+ */
+void file_save_wait()
+{
+	if (save.active) {
+		file_save_finish(1);
+	}
+}
+
+/**
+ * @brief	This routine returns how far the running save got.
+ *
+ * @return	Percentage of bytes written, -1 if no save is running
+ */
+int file_save_progress()
+{
+	if (!save.active) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&save.lock);
+	int percent = save.total ? save.written * 100 / save.total : 0;
+	pthread_mutex_unlock(&save.lock);
+
+	return percent;
+}
+
+/**
+ * @brief	This routine checks whether the buffer of a row is part
+ * 			of the snapshot being saved. Such rows have to be copied
+ * 			before they are modified.
+ */
+int file_row_shared(editor_row_t *row)
+{
+	return save.active && row->snapshot == save.id;
+}
+
+/**
+ * @brief	This routine takes over a row buffer that is still part of
+ * 			the snapshot being saved and frees it once the save is done.
+ */
+void file_retire(char *buf)
+{
+	if (save.retired_count == save.retired_capacity) {
+		save.retired_capacity =
+			save.retired_capacity ? save.retired_capacity * 2 : 64;
+		save.retired =
+			realloc(save.retired, sizeof(char *) * save.retired_capacity);
+	}
+
+	save.retired[save.retired_count++] = buf;
+}
+
+/**
+ * @brief	This routine adds a piece of text to the snapshot.
+ * 			Adjacent rows of the file mapping become a single extent.
+ */
+static void file_save_add(const char *text, size_t len, int mapped)
+{
+	if (save.count > 0) {
+		file_extent_t *last = &save.extents[save.count - 1];
+		if (mapped && last->mapped && last->text + last->len + 1 == text) {
+			last->len += len + 1;
+			save.total += len + 1;
+			return;
+		}
+	}
+
+	if (save.count == save.capacity) {
+		save.capacity = save.capacity ? save.capacity * 2 : 256;
+		save.extents =
+			realloc(save.extents, sizeof(file_extent_t) * save.capacity);
+	}
+
+	file_extent_t *extent = &save.extents[save.count++];
+	extent->text = text;
+	extent->len = len;
+	extent->mapped = mapped;
+	save.total += len + 1;
+}
+
+/**
+ * @brief	This routine captures the contents of all rows. Buffers of
+ * 			modified rows are shared with the snapshot until the save
+ * 			is done, the rest points into the file mapping.
+ */
+static void file_save_snapshot()
+{
+	save.count = 0;
+	save.total = 0;
+
+	for (int i = 0; i < roku_config.num_rows; i++) {
+		int size;
+		const char *text = editor_row_text(i, &size);
+		editor_row_t *row = document_row(i);
+
+		if (row && !(row->flags & ROW_MAPPED)) {
+			row->snapshot = save.id;
+			file_save_add(text, size, 0);
+		} else {
+			file_save_add(text, size, 1);
+		}
+	}
+}
+
+/**
+ * @brief	This routine reports the outcome of a finished save
+ * 			and releases the snapshot.
+ */
+static void file_save_finish(int join)
+{
+	if (join) {
+		pthread_join(save.thread, NULL);
+	}
+
+	if (save.error) {
+		editor_set_status("An error occured while saving: %s",
+						  strerror(save.error));
+	} else {
+		// edits made during the save are still unsaved
+		undo_saved(save.position);
+		if (save.sync_error) {
+			editor_set_status("%zu bytes written, but syncing the directory "
+							  "failed: %s",
+							  save.total, strerror(save.sync_error));
+		} else {
+			editor_set_status("%zu bytes written", save.total);
+		}
+	}
+
+	for (int i = 0; i < save.retired_count; i++) {
+		free(save.retired[i]);
+	}
+	save.retired_count = 0;
+
+	free(save.filename);
+	free(save.tmp);
+	save.filename = NULL;
+	save.tmp = NULL;
+	save.active = 0;
+}
+
+/**
+ * @brief	This routine writes an array of buffers to a file,
+ * 			retrying after partial writes.
+ *
+ * @return	status code
+ */
+static int file_writev_all(int fd, struct iovec *iov, int count)
+{
+	while (count > 0) {
+		ssize_t written = writev(fd, iov, count);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
 			}
+			return -1;
+		}
+
+		while (count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
 		}
-		close(fd);
 	}
 
-	free(buf);
-	editor_set_status("An error occured while saving: %s", strerror(errno));
+	return 0;
+}
+
+/**
+ * @brief	This routine reports the number of bytes written so far,
+ * 			waking up the main loop when the percentage changes.
+ */
+static void file_save_report(size_t written)
+{
+	pthread_mutex_lock(&save.lock);
+	int changed = save.written * 100 / save.total != written * 100 / save.total;
+	save.written = written;
+	pthread_mutex_unlock(&save.lock);
+
+	if (changed) {
+		terminal_wake();
+	}
 }
 
 /**
- * @brief	This routine converts all row buffers to a single string.
- * 
- * @return	Converted string buffer
+ * @brief	This routine streams the snapshot into the file opened by
+ * 			file_save_open(). A temporary file is renamed over the
+ * 			original, so the file is either fully written or left
+ * 			untouched.
+ *
+ * @return	status code
  */
-char *file_rows_to_string(int *buflen)
+static int file_write_snapshot()
 {
-	int len = 0;
-	int i;
+	static char newline = '\n';
+	struct iovec iov[FILE_IOV_BATCH];
+	int count = 0;
+	size_t written = 0;
+	int fd = save.fd;
+
+	size_t batch = 0;
+	for (int i = 0; i < save.count; i++) {
+		const char *text = save.extents[i].text;
+		size_t left = save.extents[i].len;
+
+		// long runs of the file mapping are written in pieces,
+		// so that the progress keeps moving
+		while (left > FILE_WRITE_CHUNK) {
+			iov[count].iov_base = (char *)text;
+			iov[count].iov_len = FILE_WRITE_CHUNK;
+			if (file_writev_all(fd, iov, count + 1) == -1) {
+				goto fail;
+			}
+			count = 0;
+			batch = 0;
+			text += FILE_WRITE_CHUNK;
+			left -= FILE_WRITE_CHUNK;
+			written += FILE_WRITE_CHUNK;
+			file_save_report(written);
+		}
+
+		iov[count].iov_base = (char *)text;
+		iov[count].iov_len = left;
+		iov[count + 1].iov_base = &newline;
+		iov[count + 1].iov_len = 1;
+		count += 2;
+		batch += left + 1;
+		written += left + 1;
+
+		if (count == FILE_IOV_BATCH || batch >= FILE_WRITE_CHUNK ||
+			i == save.count - 1) {
+			if (file_writev_all(fd, iov, count) == -1) {
+				goto fail;
+			}
+			count = 0;
+			batch = 0;
+			file_save_report(written);
+		}
+	}
+
+	// a file written in place may have been longer
+	if (save.tmp == NULL && ftruncate(fd, written) == -1) {
+		goto fail;
+	}
+	if (SAVE_FSYNC && fsync(fd) == -1) {
+		goto fail;
+	}
+	if (close(fd) == -1) {
+		fd = -1;
+		goto fail;
+	}
+	fd = -1;
+
+	if (save.tmp == NULL) {
+		return 0;
+	}
 
-	for (i = 0; i < roku_config.num_rows; i++) {
-		len += roku_config.row[i].size + 1;
+	// a mapping of the old file stays valid, it keeps the old inode alive
+	if (rename(save.tmp, save.filename) == -1) {
+		goto fail;
+	}
+	if (SAVE_FSYNC && file_sync_dir(save.filename) == -1) {
+		save.sync_error = errno;
 	}
 
-	*buflen = len;
-	char *buf = malloc(len);
-	char *p = buf;
+	return 0;
 
-	for (i = 0; i < roku_config.num_rows; i++) {
-		memcpy(p, roku_config.row[i].buf, roku_config.row[i].size);
-		p += roku_config.row[i].size;
-		*p = '\n';
-		p++;
+fail:;
+	int saved_errno = errno;
+	if (fd != -1) {
+		close(fd);
+	}
+	if (save.tmp) {
+		unlink(save.tmp);
 	}
+	errno = saved_errno;
+	return -1;
+}
+
+/**
+ * @brief	This routine is the body of the background save thread.
+ */
+static void *file_save_thread(void *arg)
+{
+	(void)arg;
+
+	int error = file_write_snapshot() == -1 ? errno : 0;
+
+	pthread_mutex_lock(&save.lock);
+	save.error = error;
+	save.done = 1;
+	pthread_mutex_unlock(&save.lock);
 
-	return buf;
+	terminal_wake();
+	return NULL;
 }
@@ -8,6 +8,39 @@
 #ifndef __FILE_H_
 #define __FILE_H_
 
+#include <stddef.h>
+
+#include "roku.h"
+
+// number of buffers handed to a single writev() call
+#define FILE_IOV_BATCH 256
+// largest number of bytes written by a single writev() call
+#define FILE_WRITE_CHUNK (1 << 20)
+// pages of the mapping read while indexing are released every this many bytes
+#define FILE_SCAN_RELEASE (64 << 20)
+// number of lines indexed before the first screen is shown
+#define FILE_LOAD_FIRST 256
+// largest number of lines handed over to the main loop at once
+#define FILE_LOAD_BATCH (1 << 16)
+
+/**
+ * @brief	This structure describes a piece of the document
+ * 			captured for saving, followed by a newline.
+ */
+typedef struct {
+	const char *text;
+	size_t len;
+	int mapped;
+} file_extent_t;
+
+/**
+ * @brief	This structure is a line found while indexing the file.
+ */
+typedef struct {
+	size_t offset;
+	int len;
+} file_line_t;
+
 /**
  * @brief	This routine opens the specified file
  * 			and displays its contents on the screen.
@@ -15,15 +48,73 @@
 void file_open(char *filename);
 
 /**
- * @brief	Saves the buffer into a file.
+ * @brief	This routine maps the specified file into memory
+ * 			and starts building the line index in the background.
+ * 			Rows are not created until something touches them.
+ *
+ * @return	status code
+ */
+int file_map(char *filename);
+
+/**
+ * @brief	This routine adds the lines indexed so far to the document.
+ * 			Nothing is added while a search is reading the document.
+ */
+void file_load_poll();
+
+/**
+ * @brief	This routine blocks until the whole file is loaded.
+ */
+void file_load_wait();
+
+/**
+ * @brief	This routine returns how far loading the file got.
+ *
+ * @return	Percentage of bytes indexed, -1 if the file is loaded
+ */
+int file_load_progress();
+
+/**
+ * @brief	This routine keeps the rows still being loaded behind
+ * 			the rows that were inserted or removed in the meantime.
+ */
+void file_load_moved(int at, int delta);
+
+/**
+ * @brief	Saves the buffer into a file. The rows are captured
+ * 			in a snapshot that is written out in the background.
  */
 void file_save();
 
 /**
- * @brief	This routine converts all row buffers to a single string.
- * 
- * @return	Converted string buffer
+ * @brief	This routine finishes a save once the background
+ * 			thread is done with it.
+ */
+void file_save_poll();
+
+/**
+ * @brief	This routine blocks until the running save is finished.
+ */
+void file_save_wait();
+
+/**
+ * @brief	This routine returns how far the running save got.
+ *
+ * @return	Percentage of bytes written, -1 if no save is running
+ */
+int file_save_progress();
+
+/**
+ * @brief	This routine checks whether the buffer of a row is part
+ * 			of the snapshot being saved. Such rows have to be copied
+ * 			before they are modified.
+ */
+int file_row_shared(editor_row_t *row);
+
+/**
+ * @brief	This routine takes over a row buffer that is still part of
+ * 			the snapshot being saved and frees it once the save is done.
  */
-char *file_rows_to_string(int *buflen);
+void file_retire(char *buf);
 
 #endif // __FILE_H_
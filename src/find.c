@@ -2,29 +2,125 @@
  * @file:		src/find.c
  * @author:		Jozef Nagy <schkwve@gmail.com>
  * @copyright:	MIT (See LICENSE.md)
- * @brief:		This file contains the routines to search queries
+ * @brief:		This file contains the routines to search queries.
+ * 				The leaves of the document are searched by a pool of
+ * 				worker threads, which count the matching rows while
+ * 				the nearest match is picked up as soon as it's found.
  */
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "config.h"
 #include "editor.h"
 #include "input.h"
 #include "roku.h"
+#include "document.h"
+#include "search.h"
+#include "regex.h"
+#include "terminal.h"
 #include "find.h"
 
+/**
+ * @brief	This structure contains what a thread needs to match rows,
+ * 			either a literal query or DFA caches of a pattern.
+ */
+typedef struct {
+	const search_t *search;
+	regex_dfa_t *dfa;
+	regex_dfa_t *reverse;
+} find_matcher_t;
+
+// bitmap of the matching rows of a leaf
+typedef unsigned char find_hits_t[DOCUMENT_LEAF_ROWS / 8];
+
+#define FIND_HIT_SET(hits, i) ((hits)[(i) / 8] |= 1 << ((i) % 8))
+#define FIND_HIT_TEST(hits, i) ((hits)[(i) / 8] & (1 << ((i) % 8)))
+#define FIND_HIT_CLEAR(hits, i) ((hits)[(i) / 8] &= ~(1 << ((i) % 8)))
+
+// state of the search session
+static struct {
+	pthread_t threads[FIND_THREADS];
+	int num_threads;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t progress;
+	int active;
+	int quit;
+
+	// leaves of the document in order, with the index of their first row
+	document_node_t **leaves;
+	int *firsts;
+	int num_leaves;
+
+	// current job, counts are -1 until a leaf is searched
+	int regex;
+	char *query;
+	search_t search;
+	regex_pattern_t *pattern;
+	const char *error;
+	find_matcher_t matcher;
+	unsigned int job;
+	int *counts;
+	find_hits_t *hits;
+	int start;
+	int direction;
+	int next;
+	int done;
+	int busy;
+
+	// results of the previous query, narrowed down by a longer one
+	char *old_query;
+	int old_regex;
+	int *old_counts;
+	find_hits_t *old_hits;
+	int narrow;
+	unsigned int edits;
+
+	// match the cursor is on, k is counted once all leaves are done
+	int match_row;
+	int match_k;
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER,
+		   .work = PTHREAD_COND_INITIALIZER,
+		   .progress = PTHREAD_COND_INITIALIZER };
+
+static void find_start(int regex);
+static void find_stop();
+static void find_keep_results();
+static void find_free_pattern();
+
 /**
  * @brief	This routine searches for a query and shows it if found.
  */
 void find()
+{
+	find_prompt("Search: %s (ESC to cancel)", 0);
+}
+
+/**
+ * @brief	This routine searches for a regular expression
+ * 			and shows the match if found.
+ */
+void find_regex()
+{
+	find_prompt("Regex search: %s (ESC to cancel)", 1);
+}
+
+/**
+ * @brief	This routine runs a search session in the prompt.
+ */
+void find_prompt(char *prompt, int regex)
 {
 	int saved_cur_x = roku_config.cur_x;
 	int saved_cur_y = roku_config.cur_y;
 	int saved_col_off = roku_config.col_off;
 	int saved_row_off = roku_config.row_off;
 
-	char *query =
-		editor_display_prompt("Search: %s (ESC to cancel)", find_callback);
+	find_start(regex);
+	char *query = editor_display_prompt(prompt, find_callback, 0);
+	find_stop();
 
 	if (query) {
 		free(query);
@@ -36,6 +132,612 @@ void find()
 	}
 }
 
+/**
+ * @brief	This routine returns the index of the slot in the range
+ * 			[lo, hi) with the largest file offset not past the specified one.
+ */
+static int find_mapped_slot(document_node_t *leaf, int lo, int hi,
+							size_t offset)
+{
+	while (hi - lo > 1) {
+		int mid = lo + (hi - lo) / 2;
+		if (leaf->offsets[mid] <= offset) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * @brief	This routine looks for the query in a piece of text,
+ * 			which may span several lines.
+ *
+ * @return	Pointer into the matching line, NULL if there is no match
+ */
+static const char *find_match(find_matcher_t *matcher, const char *text,
+							  size_t len)
+{
+	if (matcher->dfa) {
+		return regex_find(matcher->dfa, text, len);
+	}
+
+	return search_find(matcher->search, text, len);
+}
+
+/**
+ * @brief	This routine searches a run of rows that still live in the
+ * 			file mapping with a single pass over the mapped bytes.
+ * 			Text of removed rows lying in between is skipped.
+ *
+ * @return	Number of matching rows
+ */
+static int find_in_mapping(find_matcher_t *matcher, document_node_t *leaf,
+						   int lo, int hi, unsigned char *hits)
+{
+	const char *map = roku_config.file_map;
+	const char *last = map + leaf->offsets[hi - 1];
+	const char *end =
+		memchr(last, '\n', roku_config.file_map_size - (last - map));
+	if (end == NULL) {
+		end = map + roku_config.file_map_size;
+	}
+
+	int found = 0;
+	const char *pos = map + leaf->offsets[lo];
+	const char *match;
+
+	while ((match = find_match(matcher, pos, end - pos)) != NULL) {
+		int i = find_mapped_slot(leaf, lo, hi, match - map);
+		const char *line = map + leaf->offsets[i];
+
+		if (memchr(line, '\n', match - line) == NULL) {
+			FIND_HIT_SET(hits, i);
+			found++;
+		}
+
+		if (i + 1 == hi) {
+			break;
+		}
+		pos = map + leaf->offsets[i + 1];
+	}
+
+	return found;
+}
+
+/**
+ * @brief	This routine searches all rows of a leaf, marking the
+ * 			matching ones. Gaps of all rows are closed when the
+ * 			session starts, so this is safe to run on any thread.
+ *
+ * @return	Number of matching rows
+ */
+static int find_in_leaf(find_matcher_t *matcher, document_node_t *leaf,
+						unsigned char *hits)
+{
+	int found = 0;
+
+	memset(hits, 0, sizeof(find_hits_t));
+	for (int i = 0; i < leaf->count;) {
+		editor_row_t *row = document_leaf_row(leaf, i);
+
+		if (row == NULL) {
+			int j = i + 1;
+			while (j < leaf->count && document_leaf_row(leaf, j) == NULL) {
+				j++;
+			}
+
+			found += find_in_mapping(matcher, leaf, i, j, hits);
+			i = j;
+			continue;
+		}
+
+		if (find_match(matcher, row->buf, row->size)) {
+			FIND_HIT_SET(hits, i);
+			found++;
+		}
+		i++;
+	}
+
+	return found;
+}
+
+/**
+ * @brief	This routine checks whether a single row matches.
+ *
+ * @return	1 if it does, the column of the match is stored in col
+ */
+static int find_in_row(find_matcher_t *matcher, document_node_t *leaf, int i,
+					   int *col)
+{
+	editor_row_t *row = document_leaf_row(leaf, i);
+	const char *text;
+	size_t len;
+
+	if (row) {
+		text = row->buf;
+		len = row->size;
+	} else {
+		text = roku_config.file_map + leaf->offsets[i];
+		len = roku_config.file_map_size - leaf->offsets[i];
+		const char *end = memchr(text, '\n', len);
+		if (end) {
+			len = end - text;
+		}
+	}
+
+	const char *match = find_match(matcher, text, len);
+	if (match == NULL) {
+		return 0;
+	}
+
+	if (col && matcher->reverse) {
+		*col = regex_match_start(matcher->reverse, text, len);
+	} else if (col) {
+		*col = match - text;
+	}
+	return 1;
+}
+
+/**
+ * @brief	This routine rechecks only the rows of a leaf that matched
+ * 			a shorter query contained in the current one.
+ *
+ * @return	Number of matching rows
+ */
+static int find_narrow_leaf(find_matcher_t *matcher, document_node_t *leaf,
+							const unsigned char *old_hits, unsigned char *hits)
+{
+	int found = 0;
+
+	memset(hits, 0, sizeof(find_hits_t));
+	for (int i = 0; i < leaf->count; i++) {
+		if (FIND_HIT_TEST(old_hits, i) && find_in_row(matcher, leaf, i, NULL)) {
+			FIND_HIT_SET(hits, i);
+			found++;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * @brief	This routine is the body of a search worker. Leaves are
+ * 			taken in the order of their distance from the cursor.
+ */
+static void *find_worker(void *arg)
+{
+	find_matcher_t matcher = { &pool.search, NULL, NULL };
+	unsigned int job = 0;
+	(void)arg;
+
+	pthread_mutex_lock(&pool.lock);
+	while (!pool.quit) {
+		if (pool.query == NULL || pool.next == pool.num_leaves) {
+			pthread_cond_wait(&pool.work, &pool.lock);
+			continue;
+		}
+
+		int idx = pool.start + pool.direction * pool.next++;
+		idx = (idx + pool.num_leaves) % pool.num_leaves;
+		pool.busy++;
+		pthread_mutex_unlock(&pool.lock);
+
+		// every thread builds its own DFA for the pattern
+		if (job != pool.job) {
+			job = pool.job;
+			regex_dfa_free(matcher.dfa);
+			matcher.dfa = pool.pattern ? regex_dfa_new(pool.pattern, 0) : NULL;
+		}
+
+		document_node_t *leaf = pool.leaves[idx];
+		int count;
+		if (pool.narrow && pool.old_counts[idx] == 0) {
+			count = 0;
+			memset(pool.hits[idx], 0, sizeof(find_hits_t));
+		} else if (pool.narrow && pool.old_counts[idx] != -1) {
+			count = find_narrow_leaf(&matcher, leaf, pool.old_hits[idx],
+									 pool.hits[idx]);
+		} else {
+			count = find_in_leaf(&matcher, leaf, pool.hits[idx]);
+		}
+
+		pthread_mutex_lock(&pool.lock);
+		pool.busy--;
+		pool.counts[idx] = count;
+		pool.done++;
+		pthread_cond_broadcast(&pool.progress);
+
+		// let the prompt show the number of matches
+		if (pool.done == pool.num_leaves) {
+			terminal_wake();
+		}
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	regex_dfa_free(matcher.dfa);
+	return NULL;
+}
+
+/**
+ * @brief	This routine prepares the document for searching
+ * 			and starts the worker threads.
+ */
+static void find_start(int regex)
+{
+	int capacity = 16;
+	pool.leaves = malloc(sizeof(document_node_t *) * capacity);
+	pool.firsts = malloc(sizeof(int) * capacity);
+	pool.num_leaves = 0;
+
+	// workers read row buffers directly, so they have to be contiguous
+	int first;
+	document_node_t *leaf = document_find_leaf(0, &first);
+	for (; leaf; leaf = leaf->next) {
+		if (pool.num_leaves == capacity) {
+			capacity *= 2;
+			pool.leaves =
+				realloc(pool.leaves, sizeof(document_node_t *) * capacity);
+			pool.firsts = realloc(pool.firsts, sizeof(int) * capacity);
+		}
+		pool.leaves[pool.num_leaves] = leaf;
+		pool.firsts[pool.num_leaves++] = first;
+		first += leaf->count;
+
+		for (int i = 0; i < leaf->count && leaf->materialized; i++) {
+			if (leaf->materialized[i]) {
+				editor_row_close_gap(leaf->materialized[i]);
+			}
+		}
+	}
+
+	// results of the last session are still good if nothing changed since
+	if (pool.old_counts == NULL || pool.edits != roku_config.edits) {
+		free(pool.old_query);
+		free(pool.old_counts);
+		free(pool.old_hits);
+		pool.old_query = NULL;
+		pool.old_counts = malloc(sizeof(int) * pool.num_leaves);
+		pool.old_hits = malloc(sizeof(find_hits_t) * pool.num_leaves);
+	}
+
+	pool.counts = malloc(sizeof(int) * pool.num_leaves);
+	pool.hits = malloc(sizeof(find_hits_t) * pool.num_leaves);
+	pool.regex = regex;
+	pool.query = NULL;
+	pool.error = NULL;
+	pool.quit = 0;
+	pool.match_row = -1;
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	pool.num_threads = cpus < 1 ? 1 : cpus > FIND_THREADS ? FIND_THREADS : cpus;
+	for (int i = 0; i < pool.num_threads; i++) {
+		if (pthread_create(&pool.threads[i], NULL, find_worker, NULL) != 0) {
+			die("pthread_create: couldn't start search worker");
+		}
+	}
+
+	document_hold();
+	pool.active = 1;
+}
+
+/**
+ * @brief	This routine stops the worker threads. Results of the last
+ * 			query are kept for the next session.
+ */
+static void find_stop()
+{
+	pthread_mutex_lock(&pool.lock);
+	pool.quit = 1;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < pool.num_threads; i++) {
+		pthread_join(pool.threads[i], NULL);
+	}
+
+	if (pool.query) {
+		find_keep_results();
+	}
+	pool.edits = roku_config.edits;
+	find_free_pattern();
+
+	free(pool.leaves);
+	free(pool.firsts);
+	free(pool.counts);
+	free(pool.hits);
+	document_release();
+	pool.active = 0;
+}
+
+/**
+ * @brief	This routine keeps the results of the current query around,
+ * 			so that a longer query only has to recheck the matching rows.
+ */
+static void find_keep_results()
+{
+	int *counts = pool.old_counts;
+	find_hits_t *hits = pool.old_hits;
+
+	free(pool.old_query);
+	pool.old_query = pool.query;
+	pool.old_regex = pool.regex;
+	pool.old_counts = pool.counts;
+	pool.old_hits = pool.hits;
+
+	pool.query = NULL;
+	pool.counts = counts;
+	pool.hits = hits;
+}
+
+/**
+ * @brief	This routine frees the pattern of the last query
+ * 			along with the DFA caches of the main thread.
+ */
+static void find_free_pattern()
+{
+	regex_dfa_free(pool.matcher.dfa);
+	regex_dfa_free(pool.matcher.reverse);
+	regex_free(pool.pattern);
+	pool.matcher.dfa = NULL;
+	pool.matcher.reverse = NULL;
+	pool.pattern = NULL;
+}
+
+/**
+ * @brief	This routine returns the index of the leaf containing a row.
+ */
+static int find_leaf_index(int row)
+{
+	int lo = 0, hi = pool.num_leaves;
+	while (hi - lo > 1) {
+		int mid = lo + (hi - lo) / 2;
+		if (pool.firsts[mid] <= row) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * @brief	This routine hands a new query to the workers, searching
+ * 			outwards from the specified leaf. Leaves still being
+ * 			searched for the previous query are waited for.
+ * 			If the previous query is part of the new one, only rows
+ * 			that matched it are checked again.
+ *
+ * @return	status code
+ */
+static int find_submit(const char *query, int start, int direction)
+{
+	pthread_mutex_lock(&pool.lock);
+	pool.next = pool.num_leaves;
+	while (pool.busy > 0) {
+		pthread_cond_wait(&pool.progress, &pool.lock);
+	}
+
+	if (pool.query) {
+		find_keep_results();
+	}
+	find_free_pattern();
+
+	if (pool.regex) {
+		pool.pattern = regex_compile(query, &pool.error);
+		if (pool.pattern == NULL) {
+			pthread_mutex_unlock(&pool.lock);
+			return -1;
+		}
+		pool.matcher.dfa = regex_dfa_new(pool.pattern, 0);
+		pool.matcher.reverse = regex_dfa_new(pool.pattern, 1);
+	}
+	pool.error = NULL;
+	pool.matcher.search = &pool.search;
+
+	// rows matching a longer query are a subset of the old matches,
+	// which doesn't hold for patterns
+	pool.narrow = !pool.regex && pool.old_query && !pool.old_regex &&
+				  strstr(query, pool.old_query);
+	pool.query = strdup(query);
+	search_init(&pool.search, pool.query, strlen(pool.query));
+	pool.job++;
+	for (int i = 0; i < pool.num_leaves; i++) {
+		pool.counts[i] = -1;
+	}
+	pool.start = start;
+	pool.direction = direction;
+	pool.next = 0;
+	pool.done = 0;
+	pool.match_row = -1;
+
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+	return 0;
+}
+
+/**
+ * @brief	This routine waits until a leaf is searched.
+ *
+ * @return	Number of matching rows in the leaf
+ */
+static int find_wait_leaf(int idx)
+{
+	pthread_mutex_lock(&pool.lock);
+	while (pool.counts[idx] == -1) {
+		pthread_cond_wait(&pool.progress, &pool.lock);
+	}
+	int count = pool.counts[idx];
+	pthread_mutex_unlock(&pool.lock);
+
+	return count;
+}
+
+/**
+ * @brief	This routine returns the first (or last) matching slot
+ * 			of a leaf in the range [lo, hi).
+ *
+ * @return	Matching slot, -1 if there is none
+ */
+static int find_first_hit(const unsigned char *hits, int lo, int hi,
+						  int direction)
+{
+	for (int i = 0; i < hi - lo; i++) {
+		int at = direction == 1 ? lo + i : hi - 1 - i;
+		if (FIND_HIT_TEST(hits, at)) {
+			return at;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief	This routine finds the nearest match starting at the specified
+ * 			row, wrapping around at either end of the document.
+ *
+ * @return	Matching row, -1 if there is none
+ */
+static int find_nearest(int from, int direction, int *col)
+{
+	int start = find_leaf_index(from);
+	int pos = from - pool.firsts[start];
+
+	// the starting leaf is visited again at the end, for the rows
+	// on the other side of the starting row
+	for (int i = 0; i <= pool.num_leaves; i++) {
+		int idx = (start + direction * i) % pool.num_leaves;
+		idx = (idx + pool.num_leaves) % pool.num_leaves;
+		if (find_wait_leaf(idx) == 0) {
+			continue;
+		}
+
+		document_node_t *leaf = pool.leaves[idx];
+		int lo = 0, hi = leaf->count;
+		if (i == 0) {
+			if (direction == 1) {
+				lo = pos;
+			} else {
+				hi = pos + 1;
+			}
+		} else if (i == pool.num_leaves) {
+			if (direction == 1) {
+				hi = pos;
+			} else {
+				lo = pos + 1;
+			}
+		}
+
+		// a row may have been edited since its leaf was searched,
+		// it is dropped from the hits once it doesn't match any more
+		int match;
+		while ((match = find_first_hit(pool.hits[idx], lo, hi, direction)) !=
+			   -1) {
+			if (find_in_row(&pool.matcher, leaf, match, col)) {
+				return pool.firsts[idx] + match;
+			}
+
+			pthread_mutex_lock(&pool.lock);
+			FIND_HIT_CLEAR(pool.hits[idx], match);
+			pool.counts[idx]--;
+			pthread_mutex_unlock(&pool.lock);
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief	This routine searches the whole document for a query
+ * 			and collects the matching rows in order.
+ *
+ * @return	Array of row indices, NULL if nothing matches
+ */
+int *find_all(const char *query, int *count)
+{
+	find_start(0);
+	find_submit(query, 0, 1);
+
+	*count = 0;
+	for (int i = 0; i < pool.num_leaves; i++) {
+		*count += find_wait_leaf(i);
+	}
+
+	int *rows = *count ? malloc(sizeof(int) * *count) : NULL;
+	int n = 0;
+	for (int i = 0; i < pool.num_leaves && n < *count; i++) {
+		if (pool.counts[i] == 0) {
+			continue;
+		}
+		for (int j = 0; j < pool.leaves[i]->count; j++) {
+			if (FIND_HIT_TEST(pool.hits[i], j)) {
+				rows[n++] = pool.firsts[i] + j;
+			}
+		}
+	}
+
+	find_stop();
+	return rows;
+}
+
+/**
+ * @brief	This routine returns why the query couldn't be compiled.
+ *
+ * @return	Description of the error, NULL if the query is fine
+ */
+const char *find_error()
+{
+	return pool.active ? pool.error : NULL;
+}
+
+/**
+ * @brief	This routine returns the number of matching rows once all
+ * 			of them are counted, along with the index of the current one.
+ *
+ * @return	Number of matching rows, -1 if they are still being counted
+ */
+int find_match_count(int *k)
+{
+	if (!pool.active || pool.query == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	int done = pool.done == pool.num_leaves;
+	pthread_mutex_unlock(&pool.lock);
+	if (!done) {
+		return -1;
+	}
+
+	int total = 0;
+	for (int i = 0; i < pool.num_leaves; i++) {
+		total += pool.counts[i];
+	}
+
+	if (pool.match_row == -1) {
+		*k = 0;
+		return total;
+	}
+
+	if (pool.match_k == 0) {
+		int idx = find_leaf_index(pool.match_row);
+		for (int i = 0; i < idx; i++) {
+			pool.match_k += pool.counts[i];
+		}
+		for (int i = 0; i <= pool.match_row - pool.firsts[idx]; i++) {
+			if (FIND_HIT_TEST(pool.hits[idx], i)) {
+				pool.match_k++;
+			}
+		}
+	}
+
+	*k = pool.match_k;
+	return total;
+}
+
 /** 
  * @brief	This routine is a callback to the find() function
  */
@@ -46,7 +748,7 @@ void *find_callback(char *query, int key)
 
 	if (key == '\r' || key == '\n' || key == '\x1b') {
 		last_match = -1;
-		last_match = 1;
+		direction = 1;
 		return NULL;
 	} else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
 		direction = 1;
@@ -57,30 +759,38 @@ void *find_callback(char *query, int key)
 		direction = 1;
 	}
 
-	if (last_match == -1) {
-		direction = 1;
+	if (query[0] == '\0' || roku_config.num_rows == 0) {
+		return NULL;
 	}
 
-	int current = last_match;
-	for (int i = 0; i < roku_config.num_rows; i++) {
-		current += direction;
-		if (current == -1) {
-			current = roku_config.num_rows - 1;
-		} else if (current == roku_config.num_rows) {
-			current = 0;
-		}
-
-		editor_row_t *row = &roku_config.row[current];
-		char *match = strstr(row->render, query);
-		if (match) {
-			last_match = current;
-			roku_config.cur_y = current;
-			roku_config.cur_x =
-				editor_row_rx_to_cur_x(row, match - row->render);
-			roku_config.cur_x = match - row->render;
-			roku_config.row_off = roku_config.num_rows;
-			break;
+	// a new query starts at the cursor, moving on skips the last match
+	int from = roku_config.cur_y;
+	if (last_match != -1) {
+		from = last_match + direction;
+		if (from < 0) {
+			from = roku_config.num_rows - 1;
+		} else if (from >= roku_config.num_rows) {
+			from = 0;
 		}
+	} else if (from >= roku_config.num_rows) {
+		from = 0;
+	}
+
+	if (pool.query == NULL || strcmp(pool.query, query) != 0) {
+		if (find_submit(query, find_leaf_index(from), direction) == -1) {
+			return NULL;
+		}
+	}
+
+	int col = 0;
+	int match = find_nearest(from, direction, &col);
+	if (match != -1) {
+		last_match = match;
+		pool.match_row = match;
+		pool.match_k = 0;
+		roku_config.cur_y = match;
+		roku_config.cur_x = col;
+		roku_config.row_off = roku_config.num_rows;
 	}
 	return NULL;
 }
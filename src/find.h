@@ -13,9 +13,43 @@
  */
 void find();
 
+/**
+ * @brief	This routine searches for a regular expression
+ * 			and shows the match if found.
+ */
+void find_regex();
+
+/**
+ * @brief	This routine runs a search session in the prompt.
+ */
+void find_prompt(char *prompt, int regex);
+
 /** 
  * @brief	This routine is a callback to the find() function
  */
 void *find_callback(char *query, int key);
 
+/**
+ * @brief	This routine searches the whole document for a query
+ * 			and collects the matching rows in order.
+ *
+ * @return	Array of row indices, NULL if nothing matches
+ */
+int *find_all(const char *query, int *count);
+
+/**
+ * @brief	This routine returns why the query couldn't be compiled.
+ *
+ * @return	Description of the error, NULL if the query is fine
+ */
+const char *find_error();
+
+/**
+ * @brief	This routine returns the number of matching rows once all
+ * 			of them are counted, along with the index of the current one.
+ *
+ * @return	Number of matching rows, -1 if they are still being counted
+ */
+int find_match_count(int *k);
+
 #endif // __FIND_H_
@@ -0,0 +1,744 @@
+/**
+ * @file:		src/highlight.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the syntax highlighter. The state
+ * 				of the lexer at the end of every row is kept, so an edit
+ * 				only rescans rows until the state is the same as before.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "document.h"
+#include "editor.h"
+#include "highlight.h"
+#include "screen.h"
+#include "roku.h"
+
+static const char *c_extensions[] = { ".c", ".h", ".cc", ".cpp", ".hpp", NULL };
+
+static const char *c_keywords[] = {
+	"break",	"case",		"continue", "default",	 "do",
+	"else",		"enum",		"extern",	"for",		 "goto",
+	"if",		"inline",	"register", "restrict", "return",
+	"sizeof",	"static",	"struct",	"switch",	 "typedef",
+	"union",	"volatile", "while",	"class",	 "namespace",
+	"template", "typename", "public",	"private",	 "protected",
+	"new",		"delete",	"NULL",		NULL
+};
+
+static const char *c_types[] = {
+	"auto",		"bool",		"char",		 "const",	 "double",
+	"float",	"int",		"long",		 "short",	 "signed",
+	"unsigned", "void",		"size_t",	 "ssize_t", "int8_t",
+	"int16_t",	"int32_t",	"int64_t",	 "uint8_t", "uint16_t",
+	"uint32_t", "uint64_t", "uintptr_t", NULL
+};
+
+static const highlight_syntax_t highlight_syntaxes[] = {
+	{ "c", c_extensions, c_keywords, c_types, "//", "/*", "*/" },
+};
+
+#define HIGHLIGHT_SYNTAXES \
+	(sizeof(highlight_syntaxes) / sizeof(highlight_syntaxes[0]))
+
+// syntax of the open file, NULL if it isn't highlighted
+static const highlight_syntax_t *syntax = NULL;
+
+// number of rows from the top whose states are up to date
+static int frontier = 0;
+
+/**
+ * @brief	This routine picks the syntax matching the extension
+ * 			of a file. Unknown files are not highlighted. States
+ * 			of the rows are computed again from the top.
+ */
+void highlight_select(const char *filename)
+{
+	syntax = NULL;
+	frontier = 0;
+
+	const char *ext = strrchr(filename, '.');
+	if (ext == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < HIGHLIGHT_SYNTAXES; i++) {
+		for (const char **e = highlight_syntaxes[i].extensions; *e; e++) {
+			if (strcmp(ext, *e) == 0) {
+				syntax = &highlight_syntaxes[i];
+				return;
+			}
+		}
+	}
+}
+
+/**
+ * @brief	This structure is the text of a row being scanned. The text
+ * 			of a row with a gap is in two pieces, byte i is s[i] before
+ * 			split and tail[i] from there on. Attributes of the bytes
+ * 			in [base, limit) are stored in hl unless it is NULL, and
+ * 			the scan doesn't go past limit.
+ */
+typedef struct {
+	const char *s;
+	const char *tail;
+	int split;
+	int len;
+	unsigned char *hl;
+	int base;
+	int limit;
+} highlight_text_t;
+
+/**
+ * @brief	Returns the byte at the specified index of the scanned text.
+ */
+#define HIGHLIGHT_BYTE(t, i) \
+	((unsigned char)((i) < (t)->split ? (t)->s[i] : (t)->tail[i]))
+
+/**
+ * @brief	This routine sets up the text of a row to be scanned
+ * 			around its gap.
+ */
+static void highlight_row_text(highlight_text_t *text, editor_row_t *row)
+{
+	text->s = row->buf;
+	text->tail = row->buf + row->gap_len;
+	text->split = row->gap;
+	text->len = row->size;
+	text->hl = NULL;
+	text->base = 0;
+	text->limit = row->size;
+}
+
+/**
+ * @brief	This routine looks for a byte in the range [from, to)
+ * 			of the scanned text.
+ *
+ * @return	Index of the byte, -1 if it isn't there
+ */
+static int highlight_find(const highlight_text_t *text, int from, int to,
+						  int c)
+{
+	if (from >= to) {
+		return -1;
+	}
+	if (from < text->split) {
+		int end = to < text->split ? to : text->split;
+		const char *p = memchr(text->s + from, c, end - from);
+		if (p) {
+			return p - text->s;
+		}
+		from = end;
+	}
+	if (from < to) {
+		const char *p = memchr(text->tail + from, c, to - from);
+		if (p) {
+			return p - text->tail;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief	This routine checks whether a token starts at the specified
+ * 			position of the scanned text.
+ *
+ * @return	Length of the token, 0 if it doesn't start there
+ */
+static int highlight_starts(const highlight_text_t *text, int i,
+							const char *token)
+{
+	if (token == NULL) {
+		return 0;
+	}
+
+	int n = strlen(token);
+	if (text->len - i < n) {
+		return 0;
+	}
+	for (int k = 0; k < n; k++) {
+		if (HIGHLIGHT_BYTE(text, i + k) != (unsigned char)token[k]) {
+			return 0;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * @brief	This routine checks whether a word of the scanned text
+ * 			is in a list.
+ */
+static int highlight_is_word(const char **words,
+							 const highlight_text_t *text, int i, int len)
+{
+	for (; *words; words++) {
+		if ((int)strlen(*words) == len && highlight_starts(text, i, *words)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	This routine checks whether a character separates words.
+ */
+static int highlight_is_separator(int c)
+{
+	return isspace(c) || strchr(",.()+-/*=~%<>[];{}&|!?:^", c) != NULL;
+}
+
+/**
+ * @brief	This routine stores the attribute of the bytes in [from, to)
+ * 			of the scanned text, as far as they are kept.
+ */
+static void highlight_fill(highlight_text_t *text, int from, int to,
+						   int attr)
+{
+	if (text->hl == NULL) {
+		return;
+	}
+
+	if (from < text->base) {
+		from = text->base;
+	}
+	if (to > text->limit) {
+		to = text->limit;
+	}
+	if (from < to) {
+		memset(text->hl + from - text->base, attr, to - from);
+	}
+}
+
+/**
+ * @brief	This routine scans the token starting at the specified
+ * 			position, following the state of the lexer.
+ *
+ * @return	Position of the next token
+ */
+static int highlight_token(highlight_text_t *text, int i,
+						   highlight_checkpoint_t *lex)
+{
+	int len = text->len;
+	int limit = text->limit;
+
+	if (lex->state == HIGHLIGHT_COMMENT) {
+		// most of a comment is skipped without looking at it
+		int end = -1;
+		int p = i;
+		while ((p = highlight_find(text, p, limit, syntax->block_end[0])) !=
+			   -1) {
+			if (highlight_starts(text, p, syntax->block_end)) {
+				end = p;
+				break;
+			}
+			p++;
+		}
+
+		int stop = end != -1 ? end + (int)strlen(syntax->block_end) : limit;
+		highlight_fill(text, i, stop, SCREEN_ATTR_COMMENT);
+		if (end != -1) {
+			lex->state = HIGHLIGHT_NORMAL;
+			lex->separated = 1;
+		}
+		return stop;
+	}
+
+	unsigned char c = HIGHLIGHT_BYTE(text, i);
+	int n;
+
+	if (highlight_starts(text, i, syntax->line_comment)) {
+		highlight_fill(text, i, len, SCREEN_ATTR_COMMENT);
+		lex->state = HIGHLIGHT_NORMAL;
+		return len;
+	}
+
+	if ((n = highlight_starts(text, i, syntax->block_start))) {
+		highlight_fill(text, i, i + n, SCREEN_ATTR_COMMENT);
+		lex->state = HIGHLIGHT_COMMENT;
+		return i + n;
+	}
+
+	int j = i + 1;
+	int attr = SCREEN_ATTR_NORMAL;
+
+	// only words have to be read whole, their attribute depends on it
+	if (c == '"' || c == '\'') {
+		while (j < limit && HIGHLIGHT_BYTE(text, j) != c) {
+			j += HIGHLIGHT_BYTE(text, j) == '\\' ? 2 : 1;
+		}
+		if (j < limit) {
+			j++;
+		}
+		if (j > limit) {
+			j = limit;
+		}
+		attr = SCREEN_ATTR_STRING;
+		lex->separated = 1;
+	} else if (c == '#' && lex->leading) {
+		// the name of the directive goes along with it
+		while (j < limit && isspace(HIGHLIGHT_BYTE(text, j))) {
+			j++;
+		}
+		while (j < limit && (isalnum(HIGHLIGHT_BYTE(text, j)) ||
+							 HIGHLIGHT_BYTE(text, j) == '_')) {
+			j++;
+		}
+		attr = SCREEN_ATTR_PREPROC;
+		lex->separated = 1;
+	} else if (isdigit(c) && lex->separated) {
+		while (j < limit && (isalnum(HIGHLIGHT_BYTE(text, j)) ||
+							 HIGHLIGHT_BYTE(text, j) == '.')) {
+			j++;
+		}
+		attr = SCREEN_ATTR_NUMBER;
+		lex->separated = 0;
+	} else if (isalpha(c) || c == '_') {
+		while (j < len && (isalnum(HIGHLIGHT_BYTE(text, j)) ||
+						   HIGHLIGHT_BYTE(text, j) == '_')) {
+			j++;
+		}
+		if (text->hl && lex->separated) {
+			if (highlight_is_word(syntax->keywords, text, i, j - i)) {
+				attr = SCREEN_ATTR_KEYWORD;
+			} else if (highlight_is_word(syntax->types, text, i, j - i)) {
+				attr = SCREEN_ATTR_TYPE;
+			}
+		}
+		lex->separated = 0;
+	} else {
+		lex->separated = highlight_is_separator(c);
+	}
+
+	highlight_fill(text, i, j, attr);
+	if (!isspace(c)) {
+		lex->leading = 0;
+	}
+	return j;
+}
+
+/**
+ * @brief	This routine scans a line, starting in the specified state.
+ * 			Attributes of the bytes are stored in hl unless it is NULL,
+ * 			in which case only the state is followed.
+ *
+ * @return	State at the end of the line
+ */
+static int highlight_scan(const char *s, int len, int state, unsigned char *hl)
+{
+	highlight_text_t text = { s, s, len, len, hl, 0, len };
+	highlight_checkpoint_t lex = { 0, state, 1, 1 };
+
+	int i = 0;
+	while (i < len) {
+		i = highlight_token(&text, i, &lex);
+	}
+
+	return lex.state;
+}
+
+/**
+ * @brief	This routine adds lexer checkpoints to a row after the
+ * 			valid ones, keeping the rest of them after the new ones.
+ */
+static void highlight_splice(editor_row_t *row,
+							 const highlight_checkpoint_t *fresh, int count,
+							 int kept)
+{
+	int valid = row->hl_checkpoint_valid;
+	int rest = row->hl_checkpoint_count - kept;
+	int total = valid + count + rest;
+
+	if (total > row->hl_checkpoint_capacity) {
+		row->hl_checkpoint_capacity = total * 2;
+		row->hl_checkpoints =
+			realloc(row->hl_checkpoints, sizeof(highlight_checkpoint_t) *
+											 row->hl_checkpoint_capacity);
+	}
+
+	memmove(&row->hl_checkpoints[valid + count], &row->hl_checkpoints[kept],
+			sizeof(highlight_checkpoint_t) * rest);
+	memcpy(&row->hl_checkpoints[valid], fresh,
+		   sizeof(highlight_checkpoint_t) * count);
+	row->hl_checkpoint_count = total;
+	row->hl_checkpoint_valid = valid + count;
+}
+
+/**
+ * @brief	This routine brings the lexer checkpoints of a long row up to
+ * 			date as far as the specified index, scanning on from the last
+ * 			valid one. Once the scan meets a checkpoint kept from before
+ * 			an edit in the same state, the rest of the row would scan
+ * 			the same as before, so all of them are valid again.
+ */
+static void highlight_resume(editor_row_t *row, int state, int until)
+{
+	if (row->hl_checkpoints == NULL || row->hl_start != state) {
+		if (row->hl_checkpoints == NULL) {
+			row->hl_checkpoint_capacity = row->size / ROW_CHECKPOINT + 2;
+			row->hl_checkpoints = malloc(sizeof(highlight_checkpoint_t) *
+										 row->hl_checkpoint_capacity);
+		}
+		highlight_checkpoint_t first = { 0, state, 1, 1 };
+		row->hl_checkpoints[0] = first;
+		row->hl_checkpoint_count = 1;
+		row->hl_checkpoint_valid = 1;
+		row->hl_start = state;
+		row->hl_end = HIGHLIGHT_UNKNOWN;
+	}
+
+	int valid = row->hl_checkpoint_valid;
+	int count = row->hl_checkpoint_count;
+	highlight_checkpoint_t lex = row->hl_checkpoints[valid - 1];
+	if ((valid == count && row->hl_end != HIGHLIGHT_UNKNOWN) ||
+		lex.at >= until) {
+		return;
+	}
+
+	// checkpoints found by this scan
+	static highlight_checkpoint_t *fresh = NULL;
+	static int fresh_capacity = 0;
+	int fresh_count = 0;
+
+	highlight_text_t text;
+	highlight_row_text(&text, row);
+
+	int kept = valid;
+	int last = lex.at;
+	int i = lex.at;
+	while (i < row->size && i < until) {
+		i = highlight_token(&text, i, &lex);
+		lex.at = i;
+
+		while (kept < count && row->hl_checkpoints[kept].at < i) {
+			kept++;
+		}
+		if (kept < count && row->hl_checkpoints[kept].at == i &&
+			row->hl_checkpoints[kept].state == lex.state &&
+			row->hl_checkpoints[kept].separated == lex.separated &&
+			row->hl_checkpoints[kept].leading == lex.leading) {
+			highlight_splice(row, fresh, fresh_count, kept);
+			row->hl_checkpoint_valid = row->hl_checkpoint_count;
+			return;
+		}
+
+		if (i - last >= ROW_CHECKPOINT && i < row->size) {
+			if (fresh_count == fresh_capacity) {
+				fresh_capacity = fresh_capacity ? fresh_capacity * 2 : 64;
+				fresh = realloc(fresh, sizeof(highlight_checkpoint_t) *
+										   fresh_capacity);
+			}
+			fresh[fresh_count++] = lex;
+			last = i;
+		}
+	}
+
+	if (i >= row->size) {
+		// the checkpoints kept from before are of no use any more
+		kept = count;
+		row->hl_end = lex.state;
+	}
+	highlight_splice(row, fresh, fresh_count, kept);
+}
+
+/**
+ * @brief	This routine takes note of an edit of a row, which replaced
+ * 			the specified number of bytes with the inserted ones.
+ * 			Lexer checkpoints following the edit are kept to be
+ * 			checked against, the bytes after them are the same.
+ */
+void highlight_edited(editor_row_t *row, int at, int removed, int inserted)
+{
+	if (row->hl_checkpoints == NULL) {
+		return;
+	}
+
+	// a checkpoint depends on the bytes up to and including its own,
+	// the first one is where the row starts
+	highlight_checkpoint_t *cps = row->hl_checkpoints;
+	int count = row->hl_checkpoint_count;
+	int keep = 1;
+	while (keep < row->hl_checkpoint_valid && cps[keep].at < at) {
+		keep++;
+	}
+	row->hl_checkpoint_valid = keep;
+
+	// the ones kept after the edit can only be checked against once
+	// the row was scanned to the end, the bytes before them changed
+	int next = keep;
+	while (next < count && cps[next].at < at + removed) {
+		next++;
+	}
+	if (row->hl_end == HIGHLIGHT_UNKNOWN) {
+		next = count;
+	}
+
+	int moved = 0;
+	for (int k = next; k < count; k++) {
+		cps[keep + moved] = cps[k];
+		cps[keep + moved].at += inserted - removed;
+		moved++;
+	}
+	row->hl_checkpoint_count = keep + moved;
+
+	// the end of the row is only known again by meeting one of them
+	if (moved == 0) {
+		row->hl_end = HIGHLIGHT_UNKNOWN;
+	}
+}
+
+/**
+ * @brief	This routine returns the state at the end of a row,
+ * 			starting in the specified state.
+ */
+static int highlight_end_state(int at, int state)
+{
+	editor_row_t *row = document_row(at);
+	if (row && row->size > ROW_CHECKPOINT) {
+		// long rows are scanned from a checkpoint around their gap
+		highlight_resume(row, state, row->size);
+		return row->hl_end;
+	}
+
+	int len;
+	const char *s = editor_row_text(at, &len);
+	return highlight_scan(s, len, state, NULL);
+}
+
+/**
+ * @brief	This routine throws away the attributes of a row,
+ * 			since the state it starts in has changed.
+ */
+static void highlight_forget(editor_row_t *row)
+{
+	free(row->hl);
+	row->hl = NULL;
+}
+
+/**
+ * @brief	This routine computes the states at the end of the rows
+ * 			up to the specified one, continuing where it left off.
+ */
+void highlight_update(int last)
+{
+	if (syntax == NULL) {
+		return;
+	}
+
+	int state = frontier > 0 ? *document_state(frontier - 1) : HIGHLIGHT_NORMAL;
+	for (; frontier <= last && frontier < roku_config.num_rows; frontier++) {
+		state = highlight_end_state(frontier, state);
+		*document_state(frontier) = state;
+
+		editor_row_t *row = document_row(frontier);
+		if (row) {
+			highlight_forget(row);
+		}
+	}
+}
+
+/**
+ * @brief	This routine builds the attributes of a row rendered only
+ * 			as far as the window shows. The scan starts at the last
+ * 			lexer checkpoint before the window and stops at its end,
+ * 			so the cost doesn't depend on the length of the row.
+ */
+static void highlight_window(editor_row_t *row, int at)
+{
+	int col, pad;
+	int first = editor_row_window(row, row->render_col, &col, &pad);
+
+	// the blanks of a tab keep its attribute, unlike those of a wide
+	// character, to look the same as a row rendered whole
+	int tab = -1;
+	if (pad > 0) {
+		tab = editor_row_rx_to_cur_x(row, row->render_col);
+		if (ROW_CHAR(row, tab) != '\t') {
+			tab = -1;
+		}
+	}
+
+	// every byte takes up at least one byte of the render buffer
+	int from = tab != -1 ? tab : first;
+	int to = first + row->render_size - pad;
+	if (to > row->size) {
+		to = row->size;
+	}
+
+	int state = at > 0 ? *document_state(at - 1) : HIGHLIGHT_NORMAL;
+	highlight_resume(row, state, from);
+
+	int lo = 0, hi = row->hl_checkpoint_valid - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (row->hl_checkpoints[mid].at > from) {
+			hi = mid - 1;
+		} else {
+			lo = mid;
+		}
+	}
+	highlight_checkpoint_t lex = row->hl_checkpoints[lo];
+
+	highlight_text_t text;
+	highlight_row_text(&text, row);
+	unsigned char *attrs = malloc(to - from + 1);
+	text.hl = attrs;
+	text.base = from;
+	text.limit = to;
+	for (int i = lex.at; i < to;) {
+		i = highlight_token(&text, i, &lex);
+	}
+
+	row->hl = malloc(row->render_size + 1);
+	memset(row->hl, tab != -1 ? attrs[0] : SCREEN_ATTR_NORMAL, pad);
+
+	int i = first, idx = pad;
+	while (idx < row->render_size && i < row->size) {
+		int width;
+		int n = editor_row_char(row, i, col, &width);
+		if (ROW_CHAR(row, i) == '\t') {
+			memset(&row->hl[idx], attrs[i - from], width);
+			idx += width;
+		} else {
+			memcpy(&row->hl[idx], &attrs[i - from], n);
+			idx += n;
+		}
+		col += width;
+		i += n;
+	}
+
+	free(attrs);
+}
+
+/**
+ * @brief	This routine builds the attributes of the rendered
+ * 			characters of a row, unless they are up to date.
+ * 			The states of the rows above have to be computed.
+ */
+void highlight_row(editor_row_t *row, int at)
+{
+	if (syntax == NULL || row->hl) {
+		return;
+	}
+
+	if (row->flags & ROW_WINDOW) {
+		highlight_window(row, at);
+		return;
+	}
+
+	editor_row_close_gap(row);
+	unsigned char *attrs = malloc(row->size + 1);
+	int state = at > 0 ? *document_state(at - 1) : HIGHLIGHT_NORMAL;
+	highlight_scan(row->buf, row->size, state, attrs);
+
+	if (row->flags & ROW_PLAIN) {
+		row->hl = attrs;
+		return;
+	}
+
+	// the render buffer holds the same bytes, except for expanded tabs
+	row->hl = malloc(row->render_size + 1);
+	int i = 0, idx = 0, col = 0;
+	while (idx < row->render_size && i < row->size) {
+		int width;
+		int n = editor_row_char(row, i, col, &width);
+		if (row->buf[i] == '\t') {
+			memset(&row->hl[idx], attrs[i], width);
+			idx += width;
+		} else if (n == 1) {
+			row->hl[idx++] = attrs[i];
+		} else {
+			memcpy(&row->hl[idx], &attrs[i], n);
+			idx += n;
+		}
+		col += width;
+		i += n;
+	}
+
+	free(attrs);
+}
+
+/**
+ * @brief	This routine rescans rows starting at the specified one,
+ * 			until a state comes out the same as before. Rows below
+ * 			the screen are left to highlight_update().
+ */
+static void highlight_rescan(int at)
+{
+	if (at >= frontier) {
+		return;
+	}
+
+	int last = roku_config.row_off + roku_config.window_size.rows;
+	if (last < at) {
+		last = at;
+	}
+
+	int state = at > 0 ? *document_state(at - 1) : HIGHLIGHT_NORMAL;
+	for (int i = at; i < frontier; i++) {
+		if (i > last) {
+			frontier = i;
+			return;
+		}
+
+		state = highlight_end_state(i, state);
+
+		editor_row_t *row = document_row(i);
+		if (row) {
+			highlight_forget(row);
+		}
+
+		unsigned char *old = document_state(i);
+		if (*old == state) {
+			return;
+		}
+		*old = state;
+	}
+}
+
+/**
+ * @brief	This routine rescans the rows following a changed row,
+ * 			until their states are the same as before.
+ */
+void highlight_changed(editor_row_t *row)
+{
+	if (syntax == NULL || row->leaf == NULL) {
+		return;
+	}
+
+	highlight_rescan(document_row_index(row));
+}
+
+/**
+ * @brief	This routine takes note of a row inserted into the document.
+ */
+void highlight_inserted(int at)
+{
+	if (syntax == NULL || at >= frontier) {
+		return;
+	}
+
+	// the rows below start in the state they did before
+	frontier++;
+	*document_state(at) = at > 0 ? *document_state(at - 1) : HIGHLIGHT_NORMAL;
+	highlight_rescan(at);
+}
+
+/**
+ * @brief	This routine takes note of a row removed from the document.
+ */
+void highlight_removed(int at)
+{
+	if (syntax == NULL || at >= frontier) {
+		return;
+	}
+
+	frontier--;
+	highlight_rescan(at);
+}
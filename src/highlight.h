@@ -0,0 +1,78 @@
+/**
+ * @file:		src/highlight.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the syntax highlighter. The state
+ * 				of the lexer at the end of every row is kept, so an edit
+ * 				only rescans rows until the state is the same as before.
+ */
+
+#ifndef __HIGHLIGHT_H_
+#define __HIGHLIGHT_H_
+
+#include "roku.h"
+
+// lexer states carried from one row to the next
+#define HIGHLIGHT_NORMAL 0
+#define HIGHLIGHT_COMMENT 1
+// end state of a row that hasn't been scanned to the end
+#define HIGHLIGHT_UNKNOWN -1
+
+/**
+ * @brief	This structure describes the syntax of a language.
+ */
+typedef struct {
+	const char *name;
+	const char **extensions;
+	const char **keywords;
+	const char **types;
+	const char *line_comment;
+	const char *block_start;
+	const char *block_end;
+} highlight_syntax_t;
+
+/**
+ * @brief	This routine picks the syntax matching the extension
+ * 			of a file. Unknown files are not highlighted. States
+ * 			of the rows are computed again from the top.
+ */
+void highlight_select(const char *filename);
+
+/**
+ * @brief	This routine computes the states at the end of the rows
+ * 			up to the specified one, continuing where it left off.
+ */
+void highlight_update(int last);
+
+/**
+ * @brief	This routine builds the attributes of the rendered
+ * 			characters of a row, unless they are up to date.
+ * 			The states of the rows above have to be computed.
+ */
+void highlight_row(editor_row_t *row, int at);
+
+/**
+ * @brief	This routine takes note of an edit of a row, which replaced
+ * 			the specified number of bytes with the inserted ones.
+ * 			Lexer checkpoints following the edit are kept to be
+ * 			checked against, the bytes after them are the same.
+ */
+void highlight_edited(editor_row_t *row, int at, int removed, int inserted);
+
+/**
+ * @brief	This routine rescans the rows following a changed row,
+ * 			until their states are the same as before.
+ */
+void highlight_changed(editor_row_t *row);
+
+/**
+ * @brief	This routine takes note of a row inserted into the document.
+ */
+void highlight_inserted(int at);
+
+/**
+ * @brief	This routine takes note of a row removed from the document.
+ */
+void highlight_removed(int at);
+
+#endif // __HIGHLIGHT_H_
@@ -15,52 +15,137 @@
 #include "file.h"
 #include "input.h"
 #include "terminal.h"
+#include "screen.h"
 #include "find.h"
+#include "replace.h"
+#include "undo.h"
 #include "roku.h"
 
+// input read from the terminal but not processed yet
+static char input_buf[INPUT_BUF_SIZE];
+static int input_len = 0;
+static int input_pos = 0;
+
+// text of the last bracketed paste
+static char *paste_buf = NULL;
+static int paste_len = 0;
+static int paste_capacity = 0;
+
 /**
- * @brief	This routine reads keyboard input and returns it.
+ * @brief	This routine returns the next byte of input. Input is
+ * 			read from the input source in blocks and buffered.
+ *
+ * @param	c		pointer to character
+ * @param	wait	whether to wait until input arrives
+ *
+ * @return	1 if a byte was read, 0 otherwise
  */
-int input_get_keypress()
+int input_read_byte(char *c, int wait)
 {
-	int nread;
-	char c;
+	while (input_pos == input_len) {
+		if (!wait) {
+			if (!roku_config.input->wait_input(INPUT_ESC_TIMEOUT)) {
+				return 0;
+			}
+		} else {
+			switch (roku_config.input->wait(editor_status_timeout())) {
+			case EVENT_RESIZE:
+				editor_update_window_size();
+				editor_refresh_screen();
+				continue;
+			case EVENT_WAKE:
+				file_load_poll();
+				file_save_poll();
+				editor_refresh_screen();
+				// don't let busy threads keep keys from being read
+				if (roku_config.input->wait_input(0)) {
+					break;
+				}
+				continue;
+			case EVENT_TIMEOUT:
+				editor_refresh_screen();
+				continue;
+			}
+		}
 
-	while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
+		int nread = roku_config.input->read(input_buf, sizeof(input_buf));
 		if (nread == -1 && errno != EAGAIN) {
 			die("read: errno != EAGAIN");
 		}
+		if (nread == 0) {
+			// poll() reported input, so this is the end of it
+			die("read: end of input");
+		}
+
+		if (nread > 0) {
+			input_len = nread;
+			input_pos = 0;
+		}
 	}
 
+	*c = input_buf[input_pos++];
+	return 1;
+}
+
+/**
+ * @brief	This routine checks whether buffered input is waiting
+ * 			to be processed.
+ *
+ * @return	Number of buffered bytes
+ */
+int input_pending()
+{
+	return input_len - input_pos;
+}
+
+/**
+ * @brief	This routine reads keyboard input and returns it.
+ */
+int input_get_keypress()
+{
+	char c;
+
+	input_read_byte(&c, 1);
+
 	if (c == '\x1b') {
-		char seq[3];
+		char seq[2];
 
-		if (read(STDIN_FILENO, &seq[0], 1) != 1)
+		if (!input_read_byte(&seq[0], 0))
 			return '\x1b';
-		if (read(STDIN_FILENO, &seq[1], 1) != 1)
+		if (!input_read_byte(&seq[1], 0))
 			return '\x1b';
 
 		if (seq[0] == '[') {
 			if (seq[1] >= '0' && seq[1] <= '9') {
-				if (read(STDIN_FILENO, &seq[2], 1) != 1)
-					return '\x1b';
+				int num = seq[1] - '0';
+				char end;
 
-				if (seq[2] == '~') {
-					switch (seq[1]) {
-					case '1':
+				while (1) {
+					if (!input_read_byte(&end, 0))
+						return '\x1b';
+					if (end < '0' || end > '9' || num > 1000)
+						break;
+					num = num * 10 + end - '0';
+				}
+
+				if (end == '~') {
+					switch (num) {
+					case 1:
 						return HOME_KEY;
-					case '3':
+					case 3:
 						return DEL_KEY;
-					case '4':
+					case 4:
 						return END_KEY;
-					case '5':
+					case 5:
 						return PAGE_UP;
-					case '6':
+					case 6:
 						return PAGE_DOWN;
-					case '7':
+					case 7:
 						return HOME_KEY;
-					case '8':
+					case 8:
 						return END_KEY;
+					case 200:
+						return input_read_paste();
 					}
 				}
 			} else {
@@ -90,8 +175,54 @@ int input_get_keypress()
 
 		return '\x1b';
 	} else {
-		return c;
+		// bytes of UTF-8 characters are passed on one at a time
+		return (unsigned char)c;
+	}
+}
+
+/**
+ * @brief	This routine collects the text of a bracketed paste,
+ * 			up to the closing escape sequence.
+ *
+ * @return	PASTE
+ */
+int input_read_paste()
+{
+	static const char paste_end[] = "\x1b[201~";
+	int end_len = sizeof(paste_end) - 1;
+	int matched = 0;
+	char c;
+
+	paste_len = 0;
+	while (matched < end_len) {
+		input_read_byte(&c, 1);
+
+		if (paste_len == paste_capacity) {
+			paste_capacity = paste_capacity ? paste_capacity * 2 : 4096;
+			paste_buf = realloc(paste_buf, paste_capacity);
+		}
+		paste_buf[paste_len++] = c;
+
+		if (c == paste_end[matched]) {
+			matched++;
+		} else {
+			matched = c == paste_end[0];
+		}
 	}
+
+	paste_len -= end_len;
+	return PASTE;
+}
+
+/**
+ * @brief	This routine returns the text of the last bracketed paste.
+ *
+ * @return	Pasted text
+ */
+const char *input_get_paste(int *len)
+{
+	*len = paste_len;
+	return paste_buf;
 }
 
 /**
@@ -101,6 +232,11 @@ void input_handle_keypress()
 {
 	static int quit_times = 1;
 	int c = input_get_keypress();
+	undo_break();
+	// only characters typed or deleted one after another are merged
+	if ((c < ' ' && c != '\t') || (c >= ARROW_LEFT && c != DEL_KEY)) {
+		undo_seal();
+	}
 	switch (c) {
 	/* Special characters */
 	case '\r':
@@ -114,26 +250,51 @@ void input_handle_keypress()
 		editor_remove_char();
 		break;
 	case CTRL_KEY('l'):
+		screen_invalidate();
+		editor_set_status("Screen redrawn, largest frame so far: %d bytes",
+						  editor_frame_peak());
+		break;
 	case '\x1b':
 		break;
 
 	/* General keys */
 	case CTRL_KEY('q'):
+		file_save_wait();
 		if (roku_config.file_dirty && quit_times > 0) {
 			editor_set_status(
 				"File has unsaved changes. Press Ctrl-q again to quit.");
 			quit_times--;
 			return;
 		}
-		terminal_clear_screen();
+		roku_config.output->clear();
 		exit(0);
 		break;
 	case CTRL_KEY('f'):
 		find();
 		break;
+	case CTRL_KEY('r'):
+		find_regex();
+		break;
+	case CTRL_KEY('\\'):
+		replace();
+		break;
+	case CTRL_KEY('g'):
+		editor_goto();
+		break;
+	case CTRL_KEY('z'):
+		undo();
+		break;
+	case CTRL_KEY('y'):
+		redo();
+		break;
 	case CTRL_KEY('s'):
 		file_save();
 		break;
+	case PASTE: {
+		int len;
+		const char *text = input_get_paste(&len);
+		editor_insert_text(text, len);
+	} break;
 	case ARROW_LEFT:
 	case ARROW_RIGHT:
 	case ARROW_UP:
@@ -145,25 +306,13 @@ void input_handle_keypress()
 		break;
 	case END_KEY:
 		if (roku_config.cur_y < roku_config.num_rows) {
-			roku_config.cur_x = roku_config.row[roku_config.cur_y].size;
+			roku_config.cur_x = editor_get_row(roku_config.cur_y)->size;
 		}
 		break;
 	case PAGE_UP:
-	case PAGE_DOWN: {
-		if (c == PAGE_UP) {
-			roku_config.cur_y = roku_config.row_off;
-		} else if (c == PAGE_DOWN) {
-			roku_config.cur_y =
-				roku_config.row_off + roku_config.window_size.rows - 1;
-			if (roku_config.cur_y > roku_config.num_rows) {
-				roku_config.cur_y = roku_config.num_rows;
-			}
-		}
-		int times = roku_config.window_size.rows;
-		while (times--) {
-			editor_move_curpos(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
-		}
-	} break;
+	case PAGE_DOWN:
+		editor_move_page(c);
+		break;
 	default:
 		editor_insert_char(c);
 		break;
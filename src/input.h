@@ -11,6 +11,12 @@
 
 #define CTRL_KEY(k) ((k) & 0x1f)
 
+// size of the buffer input is read into
+#define INPUT_BUF_SIZE 4096
+
+// time to wait for the rest of an escape sequence, in milliseconds
+#define INPUT_ESC_TIMEOUT 50
+
 /**
  * @brief	This enumeration contains different keys
  * 			that can be pressed.
@@ -28,14 +34,51 @@ enum input_keys {
 	END_KEY,
 
 	PAGE_UP,
-	PAGE_DOWN
+	PAGE_DOWN,
+
+	// bracketed paste, see input_get_paste()
+	PASTE
 };
 
+/**
+ * @brief	This routine returns the next byte of input. Input is
+ * 			read from the input source in blocks and buffered.
+ *
+ * @param	c		pointer to character
+ * @param	wait	whether to wait until input arrives
+ *
+ * @return	1 if a byte was read, 0 otherwise
+ */
+int input_read_byte(char *c, int wait);
+
+/**
+ * @brief	This routine checks whether buffered input is waiting
+ * 			to be processed.
+ *
+ * @return	Number of buffered bytes
+ */
+int input_pending();
+
 /**
  * @brief	This routine reads keyboard input and returns it.
  */
 int input_get_keypress();
 
+/**
+ * @brief	This routine collects the text of a bracketed paste,
+ * 			up to the closing escape sequence.
+ *
+ * @return	PASTE
+ */
+int input_read_paste();
+
+/**
+ * @brief	This routine returns the text of the last bracketed paste.
+ *
+ * @return	Pasted text
+ */
+const char *input_get_paste(int *len);
+
 /**
  * @brief	This routine handles keyboard input.
  */
@@ -0,0 +1,35 @@
+/**
+ * @file:		src/io.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the interfaces the editor reads
+ * 				its input from and writes its frames to, so it can
+ * 				run without a terminal.
+ */
+
+#ifndef __IO_H_
+#define __IO_H_
+
+/**
+ * @brief	This structure contains the routines of an input source.
+ */
+typedef struct {
+	// reads up to len bytes like read(2), 0 at the end of the input
+	int (*read)(char *buf, int len);
+	// sleeps until something happens, returns a terminal_event
+	int (*wait)(int timeout);
+	// waits until input is available, returns 1 if it is
+	int (*wait_input)(int timeout);
+} io_source_t;
+
+/**
+ * @brief	This structure contains the routines of an output sink.
+ */
+typedef struct {
+	void (*write)(const char *s, int len);
+	// returns a status code
+	int (*window_size)(int *rows, int *cols);
+	void (*clear)();
+} io_sink_t;
+
+#endif // __IO_H_
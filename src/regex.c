@@ -0,0 +1,821 @@
+/**
+ * @file:		src/regex.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the regular expression engine.
+ * 				Patterns are compiled into a Thompson NFA, which is
+ * 				turned into a DFA one state at a time while searching.
+ * 				The number of cached states is bounded, so the time
+ * 				spent on a line stays linear in its length.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "regex.h"
+
+#define REGEX_CLASS 0
+#define REGEX_SPLIT 1
+#define REGEX_BOL 2
+#define REGEX_EOL 3
+#define REGEX_MATCH 4
+
+// syntax tree node types
+#define REGEX_NODE_EMPTY 0
+#define REGEX_NODE_CLASS 1
+#define REGEX_NODE_CAT 2
+#define REGEX_NODE_ALT 3
+#define REGEX_NODE_REPEAT 4
+#define REGEX_NODE_BOL 5
+#define REGEX_NODE_EOL 6
+
+// largest count allowed in a {m,n} repetition
+#define REGEX_MAX_REPEAT 1000
+
+/**
+ * @brief	This structure is a node of the syntax tree.
+ * 			A repetition without an upper bound has max set to -1.
+ */
+typedef struct regex_node {
+	int type;
+	struct regex_node *left, *right;
+	unsigned char class[32];
+	int min, max;
+} regex_node_t;
+
+/**
+ * @brief	This structure contains the state of the parser.
+ */
+typedef struct {
+	const char *p;
+	const char *error;
+} regex_parser_t;
+
+static regex_node_t *regex_parse_alt(regex_parser_t *parser);
+static int regex_match_empty(regex_dfa_t *dfa);
+
+#define REGEX_CLASS_SET(class, c) ((class)[(c) / 8] |= 1 << ((c) % 8))
+#define REGEX_CLASS_TEST(class, c) ((class)[(c) / 8] & (1 << ((c) % 8)))
+
+/**
+ * @brief	This routine allocates a syntax tree node.
+ */
+static regex_node_t *regex_node(int type, regex_node_t *left,
+								regex_node_t *right)
+{
+	regex_node_t *node = calloc(1, sizeof(regex_node_t));
+	node->type = type;
+	node->left = left;
+	node->right = right;
+	return node;
+}
+
+/**
+ * @brief	This routine frees a syntax tree.
+ */
+static void regex_free_node(regex_node_t *node)
+{
+	if (node == NULL) {
+		return;
+	}
+
+	regex_free_node(node->left);
+	regex_free_node(node->right);
+	free(node);
+}
+
+/**
+ * @brief	This routine adds a range of bytes to a class.
+ */
+static void regex_class_range(unsigned char *class, int lo, int hi)
+{
+	for (int c = lo; c <= hi; c++) {
+		REGEX_CLASS_SET(class, c);
+	}
+}
+
+/**
+ * @brief	This routine adds the bytes of a shorthand class
+ * 			such as \d to a class.
+ *
+ * @return	1 if the character names a shorthand class
+ */
+static int regex_class_escape(unsigned char *class, char c)
+{
+	unsigned char set[32] = { 0 };
+
+	switch (c | 0x20) {
+	case 'd':
+		regex_class_range(set, '0', '9');
+		break;
+	case 'w':
+		regex_class_range(set, '0', '9');
+		regex_class_range(set, 'a', 'z');
+		regex_class_range(set, 'A', 'Z');
+		REGEX_CLASS_SET(set, '_');
+		break;
+	case 's':
+		regex_class_range(set, '\t', '\r');
+		REGEX_CLASS_SET(set, ' ');
+		break;
+	default:
+		return 0;
+	}
+
+	// the upper case variants match everything else
+	for (int i = 0; i < 32; i++) {
+		class[i] |= c >= 'a' ? set[i] : ~set[i];
+	}
+	return 1;
+}
+
+/**
+ * @brief	This routine parses a bracket expression like [a-z_].
+ */
+static regex_node_t *regex_parse_class(regex_parser_t *parser)
+{
+	regex_node_t *node = regex_node(REGEX_NODE_CLASS, NULL, NULL);
+	int negate = 0;
+
+	if (*parser->p == '^') {
+		negate = 1;
+		parser->p++;
+	}
+
+	// a bracket right at the start is taken literally
+	int first = 1;
+	while (*parser->p != ']' || first) {
+		first = 0;
+
+		if (*parser->p == '\0') {
+			parser->error = "missing ]";
+			return node;
+		}
+
+		unsigned char c = *parser->p++;
+		if (c == '\\' && *parser->p) {
+			if (regex_class_escape(node->class, *parser->p)) {
+				parser->p++;
+				continue;
+			}
+			c = *parser->p++;
+		}
+
+		if (parser->p[0] == '-' && parser->p[1] != ']' && parser->p[1]) {
+			unsigned char hi = parser->p[1];
+			parser->p += 2;
+			if (hi == '\\' && *parser->p) {
+				hi = *parser->p++;
+			}
+			if (hi < c) {
+				parser->error = "invalid range";
+				return node;
+			}
+			regex_class_range(node->class, c, hi);
+		} else {
+			REGEX_CLASS_SET(node->class, c);
+		}
+	}
+	parser->p++;
+
+	if (negate) {
+		for (int i = 0; i < 32; i++) {
+			node->class[i] = ~node->class[i];
+		}
+	}
+	return node;
+}
+
+/**
+ * @brief	This routine parses a single atom of a pattern.
+ */
+static regex_node_t *regex_parse_atom(regex_parser_t *parser)
+{
+	regex_node_t *node;
+	unsigned char c = *parser->p++;
+
+	switch (c) {
+	case '(':
+		node = regex_parse_alt(parser);
+		if (*parser->p != ')') {
+			parser->error = "missing )";
+		} else {
+			parser->p++;
+		}
+		return node;
+	case '[':
+		return regex_parse_class(parser);
+	case '^':
+		return regex_node(REGEX_NODE_BOL, NULL, NULL);
+	case '$':
+		return regex_node(REGEX_NODE_EOL, NULL, NULL);
+	case '*':
+	case '+':
+	case '?':
+		parser->error = "nothing to repeat";
+		return regex_node(REGEX_NODE_EMPTY, NULL, NULL);
+	}
+
+	node = regex_node(REGEX_NODE_CLASS, NULL, NULL);
+	if (c == '.') {
+		regex_class_range(node->class, 0, 255);
+	} else if (c == '\\') {
+		if (*parser->p == '\0') {
+			parser->error = "trailing \\";
+			return node;
+		}
+		c = *parser->p++;
+		if (!regex_class_escape(node->class, c)) {
+			REGEX_CLASS_SET(node->class, c);
+		}
+	} else {
+		REGEX_CLASS_SET(node->class, c);
+	}
+
+	return node;
+}
+
+/**
+ * @brief	This routine parses a number of a {m,n} repetition.
+ *
+ * @return	The number, -1 if there is none
+ */
+static int regex_parse_number(regex_parser_t *parser)
+{
+	if (*parser->p < '0' || *parser->p > '9') {
+		return -1;
+	}
+
+	int n = 0;
+	while (*parser->p >= '0' && *parser->p <= '9') {
+		if (n <= REGEX_MAX_REPEAT) {
+			n = n * 10 + *parser->p - '0';
+		}
+		parser->p++;
+	}
+	return n;
+}
+
+/**
+ * @brief	This routine parses an atom followed by any number
+ * 			of repetition operators.
+ */
+static regex_node_t *regex_parse_repeat(regex_parser_t *parser)
+{
+	regex_node_t *node = regex_parse_atom(parser);
+
+	while (parser->error == NULL) {
+		int min, max;
+		const char *start = parser->p;
+
+		switch (*parser->p) {
+		case '*':
+			min = 0, max = -1;
+			break;
+		case '+':
+			min = 1, max = -1;
+			break;
+		case '?':
+			min = 0, max = 1;
+			break;
+		case '{':
+			parser->p++;
+			min = regex_parse_number(parser);
+			max = min;
+			if (*parser->p == ',') {
+				parser->p++;
+				max = regex_parse_number(parser);
+			}
+			// anything else is a literal brace
+			if (min == -1 || *parser->p != '}') {
+				parser->p = start;
+				return node;
+			}
+			if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT ||
+				(max != -1 && max < min)) {
+				parser->error = "invalid repetition";
+				return node;
+			}
+			break;
+		default:
+			return node;
+		}
+
+		parser->p++;
+		node = regex_node(REGEX_NODE_REPEAT, node, NULL);
+		node->min = min;
+		node->max = max;
+	}
+
+	return node;
+}
+
+/**
+ * @brief	This routine parses a sequence of atoms.
+ */
+static regex_node_t *regex_parse_cat(regex_parser_t *parser)
+{
+	regex_node_t *node = regex_node(REGEX_NODE_EMPTY, NULL, NULL);
+
+	while (parser->error == NULL && *parser->p && *parser->p != '|' &&
+		   *parser->p != ')') {
+		node = regex_node(REGEX_NODE_CAT, node, regex_parse_repeat(parser));
+	}
+
+	return node;
+}
+
+/**
+ * @brief	This routine parses alternatives separated by |.
+ */
+static regex_node_t *regex_parse_alt(regex_parser_t *parser)
+{
+	regex_node_t *node = regex_parse_cat(parser);
+
+	while (parser->error == NULL && *parser->p == '|') {
+		parser->p++;
+		node = regex_node(REGEX_NODE_ALT, node, regex_parse_cat(parser));
+	}
+
+	return node;
+}
+
+/**
+ * @brief	This routine appends an instruction to a program.
+ *
+ * @return	Index of the instruction, -1 if the program is too large
+ */
+static int regex_emit(regex_prog_t *prog, int type, int out, int out1)
+{
+	if (prog->count == REGEX_MAX_INSTS) {
+		return -1;
+	}
+
+	if (prog->count == prog->capacity) {
+		prog->capacity = prog->capacity ? prog->capacity * 2 : 64;
+		prog->insts = realloc(prog->insts, sizeof(regex_inst_t) * prog->capacity);
+	}
+
+	regex_inst_t *inst = &prog->insts[prog->count];
+	inst->type = type;
+	inst->out = out;
+	inst->out1 = out1;
+	memset(inst->class, 0, sizeof(inst->class));
+	return prog->count++;
+}
+
+/**
+ * @brief	This routine compiles a syntax tree into instructions
+ * 			continuing at next. A reversed program reads sequences
+ * 			back to front and swaps the line anchors.
+ *
+ * @return	Index of the first instruction, -1 if the program is too large
+ */
+static int regex_compile_node(regex_prog_t *prog, regex_node_t *node,
+							  int next, int reverse)
+{
+	int pc, left, right;
+
+	if (next == -1) {
+		return -1;
+	}
+
+	switch (node->type) {
+	case REGEX_NODE_EMPTY:
+		return next;
+	case REGEX_NODE_CLASS:
+		pc = regex_emit(prog, REGEX_CLASS, next, -1);
+		if (pc != -1) {
+			memcpy(prog->insts[pc].class, node->class, sizeof(node->class));
+		}
+		return pc;
+	case REGEX_NODE_BOL:
+	case REGEX_NODE_EOL:
+		if ((node->type == REGEX_NODE_BOL) != reverse) {
+			return regex_emit(prog, REGEX_BOL, next, -1);
+		}
+		return regex_emit(prog, REGEX_EOL, next, -1);
+	case REGEX_NODE_CAT:
+		if (reverse) {
+			return regex_compile_node(
+				prog, node->right,
+				regex_compile_node(prog, node->left, next, reverse), reverse);
+		}
+		return regex_compile_node(
+			prog, node->left,
+			regex_compile_node(prog, node->right, next, reverse), reverse);
+	case REGEX_NODE_ALT:
+		left = regex_compile_node(prog, node->left, next, reverse);
+		right = regex_compile_node(prog, node->right, next, reverse);
+		if (left == -1 || right == -1) {
+			return -1;
+		}
+		return regex_emit(prog, REGEX_SPLIT, left, right);
+	}
+
+	// repetition, the optional copies come after the required ones
+	if (node->max == -1) {
+		pc = regex_emit(prog, REGEX_SPLIT, -1, next);
+		if (pc == -1) {
+			return -1;
+		}
+		int body = regex_compile_node(prog, node->left, pc, reverse);
+		if (body == -1) {
+			return -1;
+		}
+		prog->insts[pc].out = body;
+		next = pc;
+	} else {
+		int end = next;
+		for (int i = node->min; i < node->max && next != -1; i++) {
+			int body = regex_compile_node(prog, node->left, next, reverse);
+			next = body == -1 ? -1 : regex_emit(prog, REGEX_SPLIT, body, end);
+		}
+	}
+
+	for (int i = 0; i < node->min && next != -1; i++) {
+		next = regex_compile_node(prog, node->left, next, reverse);
+	}
+
+	return next;
+}
+
+/**
+ * @brief	This routine compiles a syntax tree into a program.
+ *
+ * @return	status code
+ */
+static int regex_compile_prog(regex_prog_t *prog, regex_node_t *node,
+							  int reverse)
+{
+	prog->insts = NULL;
+	prog->count = 0;
+	prog->capacity = 0;
+
+	int match = regex_emit(prog, REGEX_MATCH, -1, -1);
+	prog->start = regex_compile_node(prog, node, match, reverse);
+
+	return prog->start == -1 ? -1 : 0;
+}
+
+/**
+ * @brief	This routine compiles a pattern.
+ *
+ * @return	Compiled pattern, NULL if the pattern is invalid
+ * 			(error describes what's wrong with it)
+ */
+regex_pattern_t *regex_compile(const char *pattern, const char **error)
+{
+	regex_parser_t parser = { pattern, NULL };
+	regex_node_t *node = regex_parse_alt(&parser);
+
+	if (parser.error == NULL && *parser.p == ')') {
+		parser.error = "unmatched )";
+	}
+	if (parser.error) {
+		regex_free_node(node);
+		*error = parser.error;
+		return NULL;
+	}
+
+	regex_pattern_t *re = malloc(sizeof(regex_pattern_t));
+	int forward = regex_compile_prog(&re->forward, node, 0);
+	int reverse = regex_compile_prog(&re->reverse, node, 1);
+	regex_free_node(node);
+
+	if (forward == -1 || reverse == -1) {
+		regex_free(re);
+		*error = "pattern too large";
+		return NULL;
+	}
+
+	return re;
+}
+
+/**
+ * @brief	This routine frees a compiled pattern.
+ */
+void regex_free(regex_pattern_t *re)
+{
+	if (re == NULL) {
+		return;
+	}
+
+	free(re->forward.insts);
+	free(re->reverse.insts);
+	free(re);
+}
+
+/**
+ * @brief	This routine creates an empty DFA cache for a pattern,
+ * 			reading the text either forward or backward.
+ */
+regex_dfa_t *regex_dfa_new(const regex_pattern_t *re, int reverse)
+{
+	regex_dfa_t *dfa = calloc(1, sizeof(regex_dfa_t));
+	dfa->prog = reverse ? &re->reverse : &re->forward;
+
+	int count = dfa->prog->count;
+	dfa->states = malloc(sizeof(regex_state_t) * REGEX_DFA_STATES);
+	dfa->list = malloc(sizeof(int) * count);
+	dfa->stack = malloc(sizeof(int) * (count * 2 + 2));
+	dfa->mark = calloc(count, sizeof(unsigned int));
+	dfa->empty = regex_match_empty(dfa);
+	return dfa;
+}
+
+/**
+ * @brief	This routine drops all cached states.
+ */
+static void regex_dfa_flush(regex_dfa_t *dfa)
+{
+	for (int i = 0; i < dfa->count; i++) {
+		free(dfa->states[i].set);
+	}
+
+	dfa->count = 0;
+	dfa->start = NULL;
+	dfa->flushes++;
+	memset(dfa->buckets, 0, sizeof(dfa->buckets));
+}
+
+/**
+ * @brief	This routine frees a DFA cache.
+ */
+void regex_dfa_free(regex_dfa_t *dfa)
+{
+	if (dfa == NULL) {
+		return;
+	}
+
+	regex_dfa_flush(dfa);
+	free(dfa->states);
+	free(dfa->list);
+	free(dfa->stack);
+	free(dfa->mark);
+	free(dfa);
+}
+
+/**
+ * @brief	This routine adds an instruction and everything reachable
+ * 			from it without reading a byte to the list. Anchors are
+ * 			followed only at the matching end of the line.
+ */
+static void regex_add(regex_dfa_t *dfa, int *count, int pc, int at_bol,
+					  int at_eol)
+{
+	const regex_inst_t *insts = dfa->prog->insts;
+	int top = 0;
+
+	dfa->stack[top++] = pc;
+	while (top > 0) {
+		pc = dfa->stack[--top];
+		if (dfa->mark[pc] == dfa->gen) {
+			continue;
+		}
+		dfa->mark[pc] = dfa->gen;
+
+		switch (insts[pc].type) {
+		case REGEX_SPLIT:
+			dfa->stack[top++] = insts[pc].out1;
+			dfa->stack[top++] = insts[pc].out;
+			break;
+		case REGEX_BOL:
+			if (at_bol) {
+				dfa->stack[top++] = insts[pc].out;
+			}
+			break;
+		case REGEX_EOL:
+			if (at_eol) {
+				dfa->stack[top++] = insts[pc].out;
+			} else {
+				dfa->list[(*count)++] = pc;
+			}
+			break;
+		default:
+			dfa->list[(*count)++] = pc;
+			break;
+		}
+	}
+}
+
+/**
+ * @brief	This routine starts building a new instruction list.
+ */
+static void regex_begin(regex_dfa_t *dfa)
+{
+	if (++dfa->gen == 0) {
+		memset(dfa->mark, 0, sizeof(unsigned int) * dfa->prog->count);
+		dfa->gen = 1;
+	}
+}
+
+/**
+ * @brief	This routine compares two instruction indices.
+ */
+static int regex_compare(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * @brief	This routine returns the state for the instruction list,
+ * 			creating it if it isn't cached yet.
+ */
+static regex_state_t *regex_intern(regex_dfa_t *dfa, int count)
+{
+	qsort(dfa->list, count, sizeof(int), regex_compare);
+
+	unsigned int hash = 2166136261u;
+	for (int i = 0; i < count; i++) {
+		hash = (hash ^ dfa->list[i]) * 16777619u;
+	}
+
+	regex_state_t **bucket = &dfa->buckets[hash % REGEX_DFA_BUCKETS];
+	for (regex_state_t *state = *bucket; state; state = state->chain) {
+		if (state->hash == hash && state->len == count &&
+			memcmp(state->set, dfa->list, sizeof(int) * count) == 0) {
+			return state;
+		}
+	}
+
+	if (dfa->count == REGEX_DFA_STATES) {
+		// the list lives outside of the cache, so it survives
+		regex_dfa_flush(dfa);
+		bucket = &dfa->buckets[hash % REGEX_DFA_BUCKETS];
+	}
+
+	regex_state_t *state = &dfa->states[dfa->count++];
+	memset(state->next, 0, sizeof(state->next));
+	state->set = malloc(sizeof(int) * (count ? count : 1));
+	memcpy(state->set, dfa->list, sizeof(int) * count);
+	state->len = count;
+	state->hash = hash;
+	state->chain = *bucket;
+	*bucket = state;
+
+	const regex_inst_t *insts = dfa->prog->insts;
+	state->accept = 0;
+	for (int i = 0; i < count; i++) {
+		if (insts[state->set[i]].type == REGEX_MATCH) {
+			state->accept = 1;
+		}
+	}
+
+	// see whether the end of the line completes a match
+	int eol_count = 0;
+	regex_begin(dfa);
+	for (int i = 0; i < count; i++) {
+		if (insts[state->set[i]].type == REGEX_EOL) {
+			regex_add(dfa, &eol_count, insts[state->set[i]].out, 0, 1);
+		}
+	}
+	state->accept_eol = state->accept;
+	for (int i = 0; i < eol_count; i++) {
+		if (insts[dfa->list[i]].type == REGEX_MATCH) {
+			state->accept_eol = 1;
+		}
+	}
+
+	return state;
+}
+
+/**
+ * @brief	This routine returns the state at the start of a line.
+ */
+static regex_state_t *regex_start(regex_dfa_t *dfa)
+{
+	if (dfa->start == NULL) {
+		int count = 0;
+		regex_begin(dfa);
+		regex_add(dfa, &count, dfa->prog->start, 1, 0);
+		dfa->start = regex_intern(dfa, count);
+	}
+
+	return dfa->start;
+}
+
+/**
+ * @brief	This routine checks whether the pattern matches an empty line,
+ * 			where both anchors hold at once.
+ */
+static int regex_match_empty(regex_dfa_t *dfa)
+{
+	const regex_inst_t *insts = dfa->prog->insts;
+	int count = 0;
+
+	regex_begin(dfa);
+	regex_add(dfa, &count, dfa->prog->start, 1, 1);
+	for (int i = 0; i < count; i++) {
+		if (insts[dfa->list[i]].type == REGEX_MATCH) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	This routine returns the state reached by reading a byte.
+ * 			A match may start anywhere, so the start of the program
+ * 			is added to every state.
+ */
+static regex_state_t *regex_step(regex_dfa_t *dfa, regex_state_t *state,
+								 unsigned char c)
+{
+	if (state->next[c]) {
+		return state->next[c];
+	}
+
+	const regex_inst_t *insts = dfa->prog->insts;
+	int count = 0;
+
+	regex_begin(dfa);
+	for (int i = 0; i < state->len; i++) {
+		const regex_inst_t *inst = &insts[state->set[i]];
+		if (inst->type == REGEX_CLASS && REGEX_CLASS_TEST(inst->class, c)) {
+			regex_add(dfa, &count, inst->out, 0, 0);
+		}
+	}
+	regex_add(dfa, &count, dfa->prog->start, 0, 0);
+
+	// interning may flush the cache, including this state
+	unsigned int flushes = dfa->flushes;
+	regex_state_t *next = regex_intern(dfa, count);
+	if (dfa->flushes == flushes) {
+		state->next[c] = next;
+	}
+	return next;
+}
+
+/**
+ * @brief	This routine looks for the first line of the text
+ * 			containing a match.
+ *
+ * @return	Pointer into the matching line (not past its end),
+ * 			NULL if there is no match
+ */
+const char *regex_find(regex_dfa_t *dfa, const char *text, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	const unsigned char *end = p + len;
+	const unsigned char *line = p;
+	regex_state_t *state = regex_start(dfa);
+	int empty = dfa->empty;
+
+	if (state->accept) {
+		return text;
+	}
+
+	while (p < end) {
+		unsigned char c = *p;
+
+		if (c == '\n' || (c == '\r' && (p + 1 == end || p[1] == '\n'))) {
+			if (p == line ? empty : state->accept_eol) {
+				return (const char *)p;
+			}
+			p += c == '\r' && p + 1 < end ? 2 : 1;
+			line = p;
+			state = regex_start(dfa);
+			if (state->accept) {
+				return (const char *)p;
+			}
+			continue;
+		}
+
+		state = regex_step(dfa, state, c);
+		p++;
+		if (state->accept) {
+			return (const char *)p;
+		}
+	}
+
+	if (p == line ? empty : state->accept_eol) {
+		return (const char *)end;
+	}
+	return NULL;
+}
+
+/**
+ * @brief	This routine finds where the leftmost match in a line starts,
+ * 			using a DFA created for reading backward.
+ *
+ * @return	Offset of the match, -1 if there is none
+ */
+int regex_match_start(regex_dfa_t *dfa, const char *text, size_t len)
+{
+	regex_state_t *state = regex_start(dfa);
+	int start = state->accept ? (int)len : -1;
+
+	for (size_t i = len; i > 0; i--) {
+		state = regex_step(dfa, state, text[i - 1]);
+		if (state->accept) {
+			start = i - 1;
+		}
+	}
+
+	if (len == 0 ? dfa->empty : state->accept_eol) {
+		start = 0;
+	}
+	return start;
+}
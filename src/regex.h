@@ -0,0 +1,120 @@
+/**
+ * @file:		src/regex.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the regular expression engine.
+ */
+
+#ifndef __REGEX_H_
+#define __REGEX_H_
+
+#include <stddef.h>
+
+// largest number of instructions a compiled pattern may have
+#define REGEX_MAX_INSTS 20000
+// largest number of DFA states cached before the cache is flushed
+#define REGEX_DFA_STATES 256
+#define REGEX_DFA_BUCKETS 1024
+
+/**
+ * @brief	This structure is an instruction of a compiled pattern.
+ */
+typedef struct {
+	int type;
+	int out, out1;
+	unsigned char class[32];
+} regex_inst_t;
+
+/**
+ * @brief	This structure is a Thompson NFA of a pattern.
+ */
+typedef struct {
+	regex_inst_t *insts;
+	int count;
+	int capacity;
+	int start;
+} regex_prog_t;
+
+/**
+ * @brief	This structure contains a compiled pattern, along with a copy
+ * 			reading the text backwards used to find where a match starts.
+ */
+typedef struct {
+	regex_prog_t forward;
+	regex_prog_t reverse;
+} regex_pattern_t;
+
+/**
+ * @brief	This structure is a DFA state, a set of NFA instructions.
+ * 			Transitions are filled in the first time they are taken.
+ */
+typedef struct regex_state {
+	struct regex_state *next[256];
+	struct regex_state *chain;
+	int *set;
+	int len;
+	unsigned int hash;
+	int accept;
+	int accept_eol;
+} regex_state_t;
+
+/**
+ * @brief	This structure contains the DFA states built so far.
+ * 			It is not shared between threads.
+ */
+typedef struct {
+	const regex_prog_t *prog;
+	regex_state_t *states;
+	int count;
+	regex_state_t *buckets[REGEX_DFA_BUCKETS];
+	regex_state_t *start;
+	unsigned int flushes;
+	int empty;
+	int *list;
+	int *stack;
+	unsigned int *mark;
+	unsigned int gen;
+} regex_dfa_t;
+
+/**
+ * @brief	This routine compiles a pattern.
+ *
+ * @return	Compiled pattern, NULL if the pattern is invalid
+ * 			(error describes what's wrong with it)
+ */
+regex_pattern_t *regex_compile(const char *pattern, const char **error);
+
+/**
+ * @brief	This routine frees a compiled pattern.
+ */
+void regex_free(regex_pattern_t *re);
+
+/**
+ * @brief	This routine creates an empty DFA cache for a pattern,
+ * 			reading the text either forward or backward.
+ */
+regex_dfa_t *regex_dfa_new(const regex_pattern_t *re, int reverse);
+
+/**
+ * @brief	This routine frees a DFA cache.
+ */
+void regex_dfa_free(regex_dfa_t *dfa);
+
+/**
+ * @brief	This routine looks for the first line of the text
+ * 			containing a match.
+ *
+ * @return	Pointer into the matching line (not past its end),
+ * 			NULL if there is no match
+ */
+const char *regex_find(regex_dfa_t *dfa, const char *text, size_t len);
+
+/**
+ * @brief	This routine finds where the leftmost match in a line starts,
+ * 			using a DFA created for reading backward.
+ *
+ * @return	Offset of the match, -1 if there is none
+ */
+int regex_match_start(regex_dfa_t *dfa, const char *text, size_t len);
+
+#endif // __REGEX_H_
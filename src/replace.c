@@ -0,0 +1,132 @@
+/**
+ * @file:		src/replace.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the routines to replace queries.
+ * 				Matching rows are found by the search workers first,
+ * 				then every row is rebuilt in a single pass.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "roku.h"
+#include "editor.h"
+#include "search.h"
+#include "find.h"
+#include "replace.h"
+
+/**
+ * @brief	This routine replaces every occurrence of a query.
+ */
+void replace()
+{
+	char *query =
+		editor_display_prompt("Replace: %s (ESC to cancel)", NULL, 0);
+	if (query == NULL) {
+		editor_set_status("Aborted");
+		return;
+	}
+
+	char *with =
+		editor_display_prompt("Replace with: %s (ESC to cancel)", NULL, 1);
+	if (with == NULL) {
+		free(query);
+		editor_set_status("Aborted");
+		return;
+	}
+
+	int num_rows;
+	long count = replace_all(query, with, &num_rows);
+	if (count == 0) {
+		editor_set_status("No occurrences of \"%.40s\"", query);
+	} else {
+		editor_set_status("Replaced %ld occurrences on %d lines", count,
+						  num_rows);
+	}
+
+	free(query);
+	free(with);
+}
+
+/**
+ * @brief	This routine builds the new contents of a row.
+ *
+ * @return	Number of occurrences replaced
+ */
+static long replace_in_row(editor_row_t *row, const search_t *search,
+						   const char *with, size_t with_len)
+{
+	editor_row_close_gap(row);
+
+	const char *text = row->buf;
+	const char *end = text + row->size;
+	size_t len = search->len;
+
+	// count first, so the new row is allocated only once
+	long count = 0;
+	const char *match = text;
+	while ((match = search_find(search, match, end - match)) != NULL) {
+		count++;
+		match += len;
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	size_t size = row->size - count * len + count * with_len;
+	char *buf = malloc(size + 1);
+	char *out = buf;
+	const char *pos = text;
+	while ((match = search_find(search, pos, end - pos)) != NULL) {
+		memcpy(out, pos, match - pos);
+		out += match - pos;
+		memcpy(out, with, with_len);
+		out += with_len;
+		pos = match + len;
+	}
+	memcpy(out, pos, end - pos);
+	buf[size] = '\0';
+
+	editor_row_set_text(row, buf, size);
+	return count;
+}
+
+/**
+ * @brief	This routine replaces every occurrence of a query in the
+ * 			document, rebuilding each affected row in one allocation.
+ *
+ * @return	Number of occurrences replaced
+ */
+long replace_all(const char *query, const char *with, int *num_rows)
+{
+	int *rows = find_all(query, num_rows);
+	if (rows == NULL) {
+		return 0;
+	}
+
+	search_t search;
+	search_init(&search, query, strlen(query));
+	size_t with_len = strlen(with);
+
+	long count = 0;
+	for (int i = 0; i < *num_rows; i++) {
+		editor_row_t *row = editor_get_row(rows[i]);
+		count += replace_in_row(row, &search, with, with_len);
+	}
+	free(rows);
+
+	// the whole replacement is a single change
+	if (count > 0) {
+		roku_config.file_dirty++;
+	}
+
+	if (roku_config.cur_y < roku_config.num_rows) {
+		editor_row_t *row = editor_get_row(roku_config.cur_y);
+		if (roku_config.cur_x > row->size) {
+			roku_config.cur_x = row->size;
+		}
+	}
+
+	return count;
+}
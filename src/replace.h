@@ -0,0 +1,24 @@
+/**
+ * @file:		src/replace.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the routines to replace queries.
+ */
+
+#ifndef __REPLACE_H_
+#define __REPLACE_H_
+
+/**
+ * @brief	This routine replaces every occurrence of a query.
+ */
+void replace();
+
+/**
+ * @brief	This routine replaces every occurrence of a query in the
+ * 			document, rebuilding each affected row in one allocation.
+ *
+ * @return	Number of occurrences replaced
+ */
+long replace_all(const char *query, const char *with, int *num_rows);
+
+#endif // __REPLACE_H_
@@ -0,0 +1,190 @@
+/**
+ * @file:		src/replay.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the replay mode, which applies
+ * 				a script of keystrokes to a file without a terminal.
+ * 				Frames are composed as usual, but thrown away.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "editor.h"
+#include "file.h"
+#include "input.h"
+#include "replay.h"
+#include "terminal.h"
+#include "roku.h"
+
+// keys of the script and how many of them were read
+static char *script = NULL;
+static size_t script_len = 0;
+static size_t script_pos = 0;
+
+// number of bytes of frames that would have been sent to a terminal
+static size_t output_len = 0;
+
+static int replay_read(char *buf, int len);
+static int replay_wait(int timeout);
+static int replay_wait_input(int timeout);
+static void replay_write(const char *s, int len);
+static int replay_window_size(int *rows, int *cols);
+static void replay_clear();
+
+static const io_source_t replay_source = { replay_read, replay_wait,
+										   replay_wait_input };
+
+static const io_sink_t replay_sink = { replay_write, replay_window_size,
+									   replay_clear };
+
+/**
+ * @brief	This routine reads the next keys of the script.
+ *
+ * @return	Number of bytes read, 0 at the end of the script
+ */
+static int replay_read(char *buf, int len)
+{
+	size_t left = script_len - script_pos;
+	if ((size_t)len > left) {
+		len = left;
+	}
+
+	memcpy(buf, script + script_pos, len);
+	script_pos += len;
+	return len;
+}
+
+/**
+ * @brief	This routine reports the script as input right away,
+ * 			since the rest of it is already there. Waiting past
+ * 			the end of it means a prompt was left open.
+ *
+ * @return	EVENT_INPUT
+ */
+static int replay_wait(int timeout)
+{
+	(void)timeout;
+
+	if (script_pos == script_len) {
+		fprintf(stderr, "replay: the script ended in a prompt\n");
+		exit(1);
+	}
+	return EVENT_INPUT;
+}
+
+/**
+ * @brief	This routine checks whether any keys of the script are left.
+ *
+ * @return	1 if input is available, 0 otherwise
+ */
+static int replay_wait_input(int timeout)
+{
+	(void)timeout;
+	return script_pos < script_len;
+}
+
+/**
+ * @brief	This routine counts the bytes of a frame.
+ */
+static void replay_write(const char *s, int len)
+{
+	(void)s;
+	output_len += len;
+}
+
+/**
+ * @brief	This routine returns the size of the window
+ * 			the frames are composed for.
+ *
+ * @return	status code
+ */
+static int replay_window_size(int *rows, int *cols)
+{
+	*rows = REPLAY_ROWS;
+	*cols = REPLAY_COLS;
+	return 0;
+}
+
+/**
+ * @brief	This routine does nothing, there is no screen to clear.
+ */
+static void replay_clear()
+{
+}
+
+/**
+ * @brief	This routine reads the whole script into memory.
+ */
+static void replay_load(char *script_path)
+{
+	FILE *fp = fopen(script_path, "rb");
+	if (!fp) {
+		die("fopen: couldn't open script");
+	}
+
+	char buf[INPUT_BUF_SIZE];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		script = realloc(script, script_len + n);
+		memcpy(script + script_len, buf, n);
+		script_len += n;
+	}
+	if (ferror(fp)) {
+		die("fread: couldn't read script");
+	}
+	fclose(fp);
+}
+
+/**
+ * @brief	This routine opens a file, applies the keys of a script
+ * 			to it as fast as they can be handled and saves the result.
+ * 			The script holds the bytes a terminal would send.
+ * 			It doesn't return.
+ */
+void replay_run(char *script_path, char *filename)
+{
+	roku_config.input = &replay_source;
+	roku_config.output = &replay_sink;
+
+	replay_load(script_path);
+	editor_init();
+	file_open(filename);
+	// the keys are meant for the whole file, not the part loaded so far
+	file_load_wait();
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int commands = 0;
+	while (script_pos < script_len || input_pending()) {
+		input_handle_keypress();
+		// a save finishes before the next key, so the keys that follow
+		// always see the same state
+		file_save_wait();
+		editor_refresh_screen();
+		commands++;
+	}
+
+	if (roku_config.file_dirty) {
+		file_save();
+		file_save_wait();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (roku_config.file_dirty) {
+		fprintf(stderr, "%s\n", roku_config.status_msg);
+		exit(1);
+	}
+
+	double elapsed = (end.tv_sec - start.tv_sec) +
+					 (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%zu bytes of keys replayed in %.3f s, %d commands, "
+		   "%zu bytes of output\n",
+		   script_len, elapsed, commands, output_len);
+	exit(0);
+}
@@ -0,0 +1,20 @@
+/**
+ * @file:		src/replay.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the replay mode, which applies
+ * 				a script of keystrokes to a file without a terminal.
+ */
+
+#ifndef __REPLAY_H_
+#define __REPLAY_H_
+
+/**
+ * @brief	This routine opens a file, applies the keys of a script
+ * 			to it as fast as they can be handled and saves the result.
+ * 			The script holds the bytes a terminal would send.
+ * 			It doesn't return.
+ */
+void replay_run(char *script_path, char *filename);
+
+#endif // __REPLAY_H_
@@ -8,12 +8,14 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "terminal.h"
 #include "editor.h"
 #include "input.h"
 #include "file.h"
+#include "replay.h"
 #include "roku.h"
 
 roku_config_t roku_config;
@@ -23,7 +25,18 @@ roku_config_t roku_config;
  */
 int main(int argc, char *argv[])
 {
+	if (argc >= 2 && strcmp(argv[1], "--replay") == 0) {
+		if (argc != 4) {
+			fprintf(stderr, "usage: %s --replay script.keys file\n", argv[0]);
+			return 1;
+		}
+		replay_run(argv[2], argv[3]);
+	}
+
+	roku_config.input = &terminal_source;
+	roku_config.output = &terminal_sink;
 	terminal_enable_raw();
+	terminal_init_events();
 	editor_init();
 	if (argc >= 2) {
 		file_open(argv[1]);
@@ -32,7 +45,13 @@ int main(int argc, char *argv[])
 	editor_set_status("Press C-h for help, C-q to quit.");
 
 	while (1) {
-		editor_refresh_screen();
+		// rows loaded during a search are added once it's over
+		file_load_poll();
+
+		// don't redraw until keys that are already buffered are handled
+		if (!input_pending()) {
+			editor_refresh_screen();
+		}
 		input_handle_keypress();
 	}
 
@@ -44,7 +63,7 @@ int main(int argc, char *argv[])
  */
 void die(char *msg)
 {
-	terminal_clear_screen();
+	roku_config.output->clear();
 
 	perror(msg);
 	perror("\r\n");
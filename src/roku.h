@@ -8,10 +8,33 @@
 #ifndef __ROKU_H_
 #define __ROKU_H_
 
+#include <stddef.h>
 #include <termios.h>
 #include <time.h>
 
 #include "terminal.h"
+#include "screen.h"
+
+/**
+ * @brief	This structure records the column a character of a row
+ * 			is rendered at. Checkpoint k is the first character
+ * 			starting at or after byte k * ROW_CHECKPOINT.
+ */
+typedef struct {
+	int at;
+	int rx;
+} editor_checkpoint_t;
+
+/**
+ * @brief	This structure records the state of the highlighter
+ * 			at the start of a token of a long row.
+ */
+typedef struct {
+	int at;
+	unsigned char state;
+	unsigned char separated;
+	unsigned char leading;
+} highlight_checkpoint_t;
 
 /**
  * @brief	This structure contains information about every row
@@ -22,20 +45,94 @@ typedef struct {
 	int render_size;
 	char *buf;
 	char *render;
+	// attributes of the rendered characters, NULL until highlighted
+	unsigned char *hl;
+	// column checkpoints of rows longer than ROW_CHECKPOINT,
+	// the first checkpoint_count of them are up to date
+	editor_checkpoint_t *checkpoints;
+	int checkpoint_count;
+	int checkpoint_capacity;
+	// lexer states of rows longer than ROW_CHECKPOINT, about one every
+	// ROW_CHECKPOINT bytes, see highlight.c
+	highlight_checkpoint_t *hl_checkpoints;
+	int hl_checkpoint_count;
+	int hl_checkpoint_capacity;
+	int hl_checkpoint_valid;
+	// states the row starts and ends in, as scanned for the checkpoints
+	int hl_start;
+	int hl_end;
+	int flags;
+	// gap buffer: the gap starts at gap and is gap_len bytes long,
+	// one spare byte at the end keeps room for a null terminator
+	int gap;
+	int gap_len;
+	// columns held by the render buffer of a row rendered
+	// only as far as the window shows
+	int render_col;
+	int render_cols;
+	// position in the set of rows holding a render buffer
+	int render_slot;
+	unsigned int render_frame;
+	unsigned int snapshot;
+	// leaf of the document holding the row
+	struct document_node *leaf;
 } editor_row_t;
 
+/**
+ * @brief	Returns the byte at the specified index of a row,
+ * 			skipping over the gap.
+ */
+#define ROW_CHAR(row, i) \
+	((row)->buf[(i) < (row)->gap ? (i) : (i) + (row)->gap_len])
+
+/**
+ * @brief	The row buffer is borrowed from the file mapping
+ * 			and must be copied before it is modified.
+ * 			Borrowed buffers are not null-terminated.
+ */
+#define ROW_MAPPED (1 << 0)
+
+/**
+ * @brief	The render buffer of the row is out of date
+ * 			and has to be rebuilt before it is drawn.
+ */
+#define ROW_RENDER_DIRTY (1 << 1)
+
+/**
+ * @brief	The row is plain ASCII without tabs, so every byte
+ * 			is rendered as a single column. Only valid while the
+ * 			render buffer is up to date.
+ */
+#define ROW_PLAIN (1 << 2)
+
+/**
+ * @brief	The render buffer only holds the columns of the row
+ * 			from render_col that fit in the window.
+ */
+#define ROW_WINDOW (1 << 3)
+
 /**
  * @brief	This structure contains information about the Roku configuration.
  */
 typedef struct {
 	struct termios orig_termios;
+	// where keys are read from and frames are written to
+	const io_source_t *input;
+	const io_sink_t *output;
 	terminal_winsize_t window_size;
+	screen_t screen;
 	int cur_x, cur_y;
 	int render_x;
 	int row_off;
 	int col_off;
 	int num_rows;
-	editor_row_t *row;
+	// bumped on every change to the text, so caches can tell they are stale
+	unsigned int edits;
+	struct document_node *document;
+	char *file_map;
+	size_t file_map_size;
+	// set once the mapping is replaced by a private copy
+	int file_map_owned;
 	int file_dirty;
 	char *filename;
 	char status_msg[80];
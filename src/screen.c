@@ -0,0 +1,346 @@
+/**
+ * @file:		src/screen.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the routines to compose frames
+ * 				and send only the changed parts to the terminal.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "editor.h"
+#include "screen.h"
+#include "utf8.h"
+#include "roku.h"
+
+// terminal state while a frame is being flushed
+static int term_y, term_x;
+static int term_attr;
+
+// parameters of the SGR sequence selecting each attribute
+static const char *screen_sgr[] = {
+	[SCREEN_ATTR_NORMAL] = "",
+	[SCREEN_ATTR_INVERSE] = "7",
+	[SCREEN_ATTR_COMMENT] = "36",
+	[SCREEN_ATTR_KEYWORD] = "33",
+	[SCREEN_ATTR_TYPE] = "32",
+	[SCREEN_ATTR_STRING] = "35",
+	[SCREEN_ATTR_NUMBER] = "31",
+	[SCREEN_ATTR_PREPROC] = "34",
+};
+
+/**
+ * @brief	This routine allocates the frame buffers for the
+ * 			specified terminal size and schedules a full redraw.
+ */
+void screen_resize(int rows, int cols)
+{
+	screen_t *screen = &roku_config.screen;
+
+	free(screen->front);
+	free(screen->back);
+
+	screen->rows = rows;
+	screen->cols = cols;
+	screen->front = malloc(sizeof(screen_cell_t) * rows * cols);
+	screen->back = malloc(sizeof(screen_cell_t) * rows * cols);
+	screen->cursor_y = -1;
+	screen->cursor_x = -1;
+
+	screen_invalidate();
+	screen_clear();
+}
+
+/**
+ * @brief	This routine makes the next flush repaint the whole screen.
+ */
+void screen_invalidate()
+{
+	roku_config.screen.full_redraw = 1;
+}
+
+/**
+ * @brief	This routine makes a cell hold a blank.
+ */
+static void screen_blank(screen_cell_t *cell, unsigned char attr)
+{
+	cell->ch[0] = ' ';
+	cell->len = 1;
+	cell->attr = attr;
+}
+
+/**
+ * @brief	This routine blanks the frame being composed.
+ */
+void screen_clear()
+{
+	screen_t *screen = &roku_config.screen;
+
+	for (int i = 0; i < screen->rows * screen->cols; i++) {
+		screen_blank(&screen->back[i], SCREEN_ATTR_NORMAL);
+	}
+}
+
+/**
+ * @brief	This routine writes a UTF-8 string into the frame being
+ * 			composed. Anything past the right edge of the screen
+ * 			is cut off.
+ *
+ * @return	Number of columns written
+ */
+int screen_put(int y, int x, const char *s, int len, unsigned char attr)
+{
+	screen_t *screen = &roku_config.screen;
+
+	if (y < 0 || y >= screen->rows || x < 0 || x >= screen->cols) {
+		return 0;
+	}
+
+	screen_cell_t *line = &screen->back[y * screen->cols];
+	int start = x;
+
+	// don't leave half of a wide character behind
+	if (x > 0 && line[x].len == 0) {
+		screen_blank(&line[x - 1], line[x - 1].attr);
+	}
+
+	int i = 0;
+	while (i < len && x < screen->cols) {
+		int cp;
+		int n = utf8_decode(s + i, len - i, &cp);
+		int width = cp == -1 ? 1 : utf8_width(cp);
+
+		if (width == 0) {
+			// combining marks go into the cell of the character before
+			if (x > start) {
+				screen_cell_t *base = &line[x - 1];
+				if (base->len == 0) {
+					base--;
+				}
+				if (base->len + n <= SCREEN_CELL_BYTES) {
+					memcpy(base->ch + base->len, s + i, n);
+					base->len += n;
+				}
+			}
+			i += n;
+			continue;
+		}
+
+		screen_cell_t *cell = &line[x];
+		if (x + width > screen->cols) {
+			screen_blank(cell, attr);
+			x++;
+			break;
+		}
+
+		if (cp == -1) {
+			cell->ch[0] = UTF8_INVALID;
+			cell->len = 1;
+		} else {
+			memcpy(cell->ch, s + i, n);
+			cell->len = n;
+		}
+		cell->attr = attr;
+
+		if (width == 2) {
+			cell[1].len = 0;
+			cell[1].attr = attr;
+		}
+		x += width;
+		i += n;
+	}
+
+	if (x < screen->cols && line[x].len == 0) {
+		screen_blank(&line[x], line[x].attr);
+	}
+
+	return x - start;
+}
+
+/**
+ * @brief	This routine fills part of a line with blanks
+ * 			of the specified attribute.
+ */
+void screen_fill(int y, int x, int len, unsigned char attr)
+{
+	screen_t *screen = &roku_config.screen;
+
+	if (y < 0 || y >= screen->rows || x < 0) {
+		return;
+	}
+	if (x + len > screen->cols) {
+		len = screen->cols - x;
+	}
+
+	screen_cell_t *cell = &screen->back[y * screen->cols + x];
+	for (int i = 0; i < len; i++) {
+		screen_blank(&cell[i], attr);
+	}
+}
+
+/**
+ * @brief	This routine compares two cells.
+ */
+static int screen_cell_equal(screen_cell_t *a, screen_cell_t *b)
+{
+	return a->len == b->len && a->attr == b->attr &&
+		   memcmp(a->ch, b->ch, a->len) == 0;
+}
+
+/**
+ * @brief	This routine moves the terminal cursor unless it
+ * 			is already at the specified position.
+ */
+static void screen_move(struct append_buf *buf, int y, int x)
+{
+	if (y == term_y && x == term_x) {
+		return;
+	}
+
+	if (term_y != -1 && y == term_y + 1 && x == 0 && term_x != -1) {
+		editor_buffer_append(buf, "\r\n", 2);
+	} else {
+		char seq[32];
+		int len = snprintf(seq, sizeof(seq), "\x1b[%d;%dH", y + 1, x + 1);
+		editor_buffer_append(buf, seq, len);
+	}
+
+	term_y = y;
+	term_x = x;
+}
+
+/**
+ * @brief	This routine switches the terminal to the specified attribute.
+ */
+static void screen_set_attr(struct append_buf *buf, int attr)
+{
+	if (attr == term_attr) {
+		return;
+	}
+
+	if (attr == SCREEN_ATTR_NORMAL) {
+		editor_buffer_append(buf, "\x1b[m", 3);
+	} else {
+		// switching between two attributes resets the first one
+		char seq[16];
+		int len = snprintf(seq, sizeof(seq), "\x1b[%s%sm",
+						   term_attr == SCREEN_ATTR_NORMAL ? "" : "0;",
+						   screen_sgr[attr]);
+		editor_buffer_append(buf, seq, len);
+	}
+	term_attr = attr;
+}
+
+/**
+ * @brief	This routine appends the escape sequences needed to turn
+ * 			the previous frame into the composed one to the write buffer,
+ * 			and places the cursor at the specified position.
+ */
+void screen_flush(struct append_buf *buf, int cur_y, int cur_x)
+{
+	screen_t *screen = &roku_config.screen;
+	int cols = screen->cols;
+	int hidden = 0;
+
+	// every flush leaves the terminal with the normal attribute
+	term_y = -1;
+	term_x = -1;
+	term_attr = SCREEN_ATTR_NORMAL;
+
+	if (screen->full_redraw) {
+		editor_buffer_append(buf, "\x1b[?25l", 6);
+		editor_buffer_append(buf, "\x1b[m\x1b[2J", 7);
+		hidden = 1;
+
+		for (int i = 0; i < screen->rows * cols; i++) {
+			screen_blank(&screen->front[i], SCREEN_ATTR_NORMAL);
+		}
+		screen->full_redraw = 0;
+	}
+
+	for (int y = 0; y < screen->rows; y++) {
+		screen_cell_t *back = &screen->back[y * cols];
+		screen_cell_t *front = &screen->front[y * cols];
+
+		// everything after the last non-blank cell can be erased at once
+		int last = cols - 1;
+		while (last >= 0 && back[last].len == 1 && back[last].ch[0] == ' ' &&
+			   back[last].attr == SCREEN_ATTR_NORMAL) {
+			last--;
+		}
+
+		int x = 0;
+		while (x < cols) {
+			if (screen_cell_equal(&back[x], &front[x])) {
+				x++;
+				continue;
+			}
+
+			if (!hidden) {
+				editor_buffer_append(buf, "\x1b[?25l", 6);
+				hidden = 1;
+			}
+			screen_move(buf, y, x);
+
+			if (x > last) {
+				screen_set_attr(buf, SCREEN_ATTR_NORMAL);
+				editor_buffer_append(buf, "\x1b[K", 3);
+				memcpy(&front[x], &back[x],
+					   sizeof(screen_cell_t) * (cols - x));
+				break;
+			}
+
+			// extend the run over short stretches of unchanged cells,
+			// rewriting them is cheaper than moving the cursor
+			int end = x;
+			while (end <= last) {
+				if (!screen_cell_equal(&back[end], &front[end])) {
+					end++;
+					continue;
+				}
+
+				int same = end;
+				while (same <= last &&
+					   screen_cell_equal(&back[same], &front[same])) {
+					same++;
+				}
+				if (same > last || same - end >= SCREEN_GAP_REWRITE) {
+					break;
+				}
+				end = same;
+			}
+
+			// both halves of a wide character are written together
+			if (end < cols && back[end].len == 0) {
+				end++;
+			}
+
+			for (int i = x; i < end; i++) {
+				front[i] = back[i];
+				if (back[i].len == 0) {
+					continue;
+				}
+				screen_set_attr(buf, back[i].attr);
+				editor_buffer_append(buf, back[i].ch, back[i].len);
+			}
+
+			// writing the last column leaves the cursor in limbo
+			term_x = end == cols ? -1 : end;
+			x = end;
+		}
+	}
+
+	screen_set_attr(buf, SCREEN_ATTR_NORMAL);
+
+	if (hidden || cur_y != screen->cursor_y || cur_x != screen->cursor_x) {
+		screen_move(buf, cur_y, cur_x);
+		screen->cursor_y = cur_y;
+		screen->cursor_x = cur_x;
+	}
+
+	if (hidden) {
+		editor_buffer_append(buf, "\x1b[?25h", 6);
+	}
+}
@@ -0,0 +1,89 @@
+/**
+ * @file:		src/screen.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the routines to compose frames
+ * 				and send only the changed parts to the terminal.
+ */
+
+#ifndef __SCREEN_H_
+#define __SCREEN_H_
+
+struct append_buf;
+
+#define SCREEN_ATTR_NORMAL 0
+#define SCREEN_ATTR_INVERSE 1
+#define SCREEN_ATTR_COMMENT 2
+#define SCREEN_ATTR_KEYWORD 3
+#define SCREEN_ATTR_TYPE 4
+#define SCREEN_ATTR_STRING 5
+#define SCREEN_ATTR_NUMBER 6
+#define SCREEN_ATTR_PREPROC 7
+
+// unchanged cells shorter than this are rewritten instead of skipped over
+#define SCREEN_GAP_REWRITE 6
+// room for the UTF-8 encoding of a character and a combining mark
+#define SCREEN_CELL_BYTES 8
+
+/**
+ * @brief	This structure describes a single character cell.
+ * 			The cell right of a wide character is left empty (len 0).
+ */
+typedef struct {
+	char ch[SCREEN_CELL_BYTES];
+	unsigned char len;
+	unsigned char attr;
+} screen_cell_t;
+
+/**
+ * @brief	This structure contains the frame being composed
+ * 			and a copy of what the terminal currently shows.
+ */
+typedef struct {
+	int rows;
+	int cols;
+	screen_cell_t *front;
+	screen_cell_t *back;
+	int full_redraw;
+	int cursor_y, cursor_x;
+} screen_t;
+
+/**
+ * @brief	This routine allocates the frame buffers for the
+ * 			specified terminal size and schedules a full redraw.
+ */
+void screen_resize(int rows, int cols);
+
+/**
+ * @brief	This routine makes the next flush repaint the whole screen.
+ */
+void screen_invalidate();
+
+/**
+ * @brief	This routine blanks the frame being composed.
+ */
+void screen_clear();
+
+/**
+ * @brief	This routine writes a UTF-8 string into the frame being
+ * 			composed. Anything past the right edge of the screen
+ * 			is cut off.
+ *
+ * @return	Number of columns written
+ */
+int screen_put(int y, int x, const char *s, int len, unsigned char attr);
+
+/**
+ * @brief	This routine fills part of a line with blanks
+ * 			of the specified attribute.
+ */
+void screen_fill(int y, int x, int len, unsigned char attr);
+
+/**
+ * @brief	This routine appends the escape sequences needed to turn
+ * 			the previous frame into the composed one to the write buffer,
+ * 			and places the cursor at the specified position.
+ */
+void screen_flush(struct append_buf *buf, int cur_y, int cur_x);
+
+#endif // __SCREEN_H_
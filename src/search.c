@@ -0,0 +1,100 @@
+/**
+ * @file:		src/search.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the substring search kernel.
+ * 				Candidates are found by comparing the first and last
+ * 				byte of the query against 16 positions at once, with
+ * 				a Horspool skip loop for the tail and for builds
+ * 				without SSE2.
+ */
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "search.h"
+
+/**
+ * @brief	This routine prepares a query for searching.
+ * 			The query has to stay around while it's being used.
+ */
+void search_init(search_t *search, const char *needle, size_t len)
+{
+	search->needle = (const unsigned char *)needle;
+	search->len = len;
+
+	for (int i = 0; i < 256; i++) {
+		search->skip[i] = len;
+	}
+	for (size_t i = 0; i + 1 < len; i++) {
+		search->skip[search->needle[i]] = len - 1 - i;
+	}
+}
+
+/**
+ * @brief	This routine searches using the Horspool skip table.
+ *
+ * @return	Pointer to the match, NULL if there is none
+ */
+static const char *search_horspool(const search_t *search, const char *hay,
+								   size_t len)
+{
+	const unsigned char *s = (const unsigned char *)hay;
+	const unsigned char *needle = search->needle;
+	size_t n = search->len;
+
+	size_t pos = 0;
+	while (pos + n <= len) {
+		unsigned char last = s[pos + n - 1];
+		if (last == needle[n - 1] && memcmp(s + pos, needle, n - 1) == 0) {
+			return hay + pos;
+		}
+		pos += search->skip[last];
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	This routine looks for the first occurrence of the query.
+ *
+ * @return	Pointer to the match, NULL if there is none
+ */
+const char *search_find(const search_t *search, const char *hay, size_t len)
+{
+	size_t n = search->len;
+
+	if (n == 0 || n > len) {
+		return NULL;
+	}
+	if (n == 1) {
+		return memchr(hay, search->needle[0], len);
+	}
+
+	size_t pos = 0;
+
+#ifdef __SSE2__
+	const __m128i first = _mm_set1_epi8(search->needle[0]);
+	const __m128i last = _mm_set1_epi8(search->needle[n - 1]);
+
+	for (; pos + n - 1 + 16 <= len; pos += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(hay + pos));
+		__m128i b = _mm_loadu_si128((const __m128i *)(hay + pos + n - 1));
+		unsigned int mask = _mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+		while (mask) {
+			int bit = __builtin_ctz(mask);
+			if (memcmp(hay + pos + bit + 1, search->needle + 1, n - 2) == 0) {
+				return hay + pos + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	return search_horspool(search, hay + pos, len - pos);
+}
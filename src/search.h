@@ -0,0 +1,35 @@
+/**
+ * @file:		src/search.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the substring search kernel.
+ */
+
+#ifndef __SEARCH_H_
+#define __SEARCH_H_
+
+#include <stddef.h>
+
+/**
+ * @brief	This structure contains a query prepared for searching.
+ */
+typedef struct {
+	const unsigned char *needle;
+	size_t len;
+	size_t skip[256];
+} search_t;
+
+/**
+ * @brief	This routine prepares a query for searching.
+ * 			The query has to stay around while it's being used.
+ */
+void search_init(search_t *search, const char *needle, size_t len);
+
+/**
+ * @brief	This routine looks for the first occurrence of the query.
+ *
+ * @return	Pointer to the match, NULL if there is none
+ */
+const char *search_find(const search_t *search, const char *hay, size_t len);
+
+#endif // __SEARCH_H_
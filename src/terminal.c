@@ -7,7 +7,13 @@
  */
 
 #include <termios.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
@@ -15,6 +21,19 @@
 #include "terminal.h"
 #include "roku.h"
 
+// self-pipe written to by terminal_wake()
+static int wake_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t resize_pending = 0;
+
+static int terminal_read(char *buf, int len);
+static void terminal_write(const char *s, int len);
+
+const io_source_t terminal_source = { terminal_read, terminal_wait,
+									  terminal_wait_input };
+
+const io_sink_t terminal_sink = { terminal_write, terminal_get_window_size,
+								  terminal_clear_screen };
+
 /**
  * @brief	This routine clears the terminal screen and repositions
  * 			the cursor to 0,0.
@@ -66,7 +85,8 @@ int terminal_get_curpos(int *rows, int *cols)
 		return -1;
 
 	while (i < sizeof(buf) - 1) {
-		if (read(STDIN_FILENO, &buf[i], 1) != 1)
+		if (!terminal_wait_input(1000) ||
+			read(STDIN_FILENO, &buf[i], 1) != 1)
 			break;
 
 		if (buf[i] == 'R')
@@ -81,7 +101,7 @@ int terminal_get_curpos(int *rows, int *cols)
 	if (sscanf(&buf[2], "%d;%d", rows, cols) != 2)
 		return -1;
 
-	return -1;
+	return 0;
 }
 
 /**
@@ -120,7 +140,10 @@ void terminal_enable_raw()
 	// modify input terminal flags;
 	//	~IXON - disable software flow control processing
 	//			(Ctrl-S, Ctrl-Q, ...)
+	//	~ICRNL - don't translate carriage returns into newlines,
+	//			 pasted \r\n line endings would turn into two lines
 	new_terminal_flags.c_iflag &= ~(IXON);
+	new_terminal_flags.c_iflag &= ~(ICRNL);
 
 	// modify output terminal flags:
 	//	~OPOST - disable output processing
@@ -129,13 +152,17 @@ void terminal_enable_raw()
 	// modify control characters:
 	//	VMIN - minimum number of bytes before read() can return
 	//	VTIME - read() timeout (set in 1/10th of a second)
+	// read() never blocks, waiting for input is done by terminal_wait()
 	new_terminal_flags.c_cc[VMIN] = 0;
-	new_terminal_flags.c_cc[VTIME] = 1;
+	new_terminal_flags.c_cc[VTIME] = 0;
 
 	// set updated terminal flags
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &new_terminal_flags) == -1) {
 		die("tcsetattr: couldn't set terminal flags");
 	}
+
+	// enable bracketed paste, so pasted text can be inserted at once
+	write(STDOUT_FILENO, "\x1b[?2004h", 8);
 }
 
 /**
@@ -144,5 +171,122 @@ void terminal_enable_raw()
  */
 void terminal_reset()
 {
+	write(STDOUT_FILENO, "\x1b[?2004l", 8);
 	tcsetattr(STDIN_FILENO, TCSAFLUSH, &roku_config.orig_termios);
 }
+
+/**
+ * @brief	This routine is the SIGWINCH handler.
+ */
+static void terminal_handle_sigwinch(int sig)
+{
+	(void)sig;
+	resize_pending = 1;
+	terminal_wake();
+}
+
+/**
+ * @brief	This routine creates the self-pipe used to wake up
+ * 			terminal_wait() and installs the SIGWINCH handler.
+ */
+void terminal_init_events()
+{
+	if (pipe(wake_pipe) == -1) {
+		die("pipe: couldn't create wake pipe");
+	}
+
+	fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = terminal_handle_sigwinch;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(SIGWINCH, &sa, NULL) == -1) {
+		die("sigaction: couldn't install SIGWINCH handler");
+	}
+}
+
+/**
+ * @brief	This routine wakes up terminal_wait().
+ * 			It is safe to call from signal handlers and other threads.
+ */
+void terminal_wake()
+{
+	int saved_errno = errno;
+	char c = 0;
+
+	// if the pipe is full, a wake up is already pending
+	write(wake_pipe[1], &c, 1);
+	errno = saved_errno;
+}
+
+/**
+ * @brief	This routine sleeps until input arrives, the window
+ * 			is resized, terminal_wake() is called or the timeout
+ * 			(in milliseconds, -1 for none) expires.
+ *
+ * @return	terminal_event
+ */
+int terminal_wait(int timeout)
+{
+	struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 },
+							 { wake_pipe[0], POLLIN, 0 } };
+
+	int ret = poll(fds, 2, timeout);
+	if (ret == -1 && errno != EINTR) {
+		die("poll: couldn't wait for input");
+	}
+
+	int woken = ret == -1;
+	if (ret > 0 && fds[1].revents) {
+		char drain[64];
+		while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+			;
+		woken = 1;
+	}
+
+	if (resize_pending) {
+		resize_pending = 0;
+		return EVENT_RESIZE;
+	}
+	if (woken) {
+		return EVENT_WAKE;
+	}
+	if (ret > 0 && fds[0].revents) {
+		return EVENT_INPUT;
+	}
+	return EVENT_TIMEOUT;
+}
+
+/**
+ * @brief	This routine waits until input is available
+ * 			or the timeout (in milliseconds) expires.
+ *
+ * @return	1 if input is available, 0 otherwise
+ */
+int terminal_wait_input(int timeout)
+{
+	struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+	return poll(&fd, 1, timeout) > 0;
+}
+
+/**
+ * @brief	This routine reads the input available on the terminal
+ * 			without waiting for more.
+ *
+ * @return	Number of bytes read, -1 if there are none
+ */
+static int terminal_read(char *buf, int len)
+{
+	return read(STDIN_FILENO, buf, len);
+}
+
+/**
+ * @brief	This routine writes a frame to the terminal.
+ */
+static void terminal_write(const char *s, int len)
+{
+	write(STDOUT_FILENO, s, len);
+}
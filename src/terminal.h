@@ -9,6 +9,19 @@
 #ifndef __TERMINAL_H_
 #define __TERMINAL_H_
 
+#include "io.h"
+
+/**
+ * @brief	This enumeration contains the events
+ * 			terminal_wait() can report.
+ */
+enum terminal_event {
+	EVENT_INPUT,
+	EVENT_RESIZE,
+	EVENT_WAKE,
+	EVENT_TIMEOUT
+};
+
 /**
  * @brief	This structure contains information about the terminal's
  * 			window size.
@@ -18,6 +31,10 @@ typedef struct {
 	int cols;
 } terminal_winsize_t;
 
+// the terminal as the input source and output sink of the editor
+extern const io_source_t terminal_source;
+extern const io_sink_t terminal_sink;
+
 /**
  * @brief	This routine clears the terminal screen and repositions
  * 			the cursor to 0,0.
@@ -58,4 +75,33 @@ void terminal_enable_raw();
  */
 void terminal_reset();
 
+/**
+ * @brief	This routine creates the self-pipe used to wake up
+ * 			terminal_wait() and installs the SIGWINCH handler.
+ */
+void terminal_init_events();
+
+/**
+ * @brief	This routine wakes up terminal_wait().
+ * 			It is safe to call from signal handlers and other threads.
+ */
+void terminal_wake();
+
+/**
+ * @brief	This routine sleeps until input arrives, the window
+ * 			is resized, terminal_wake() is called or the timeout
+ * 			(in milliseconds, -1 for none) expires.
+ *
+ * @return	terminal_event
+ */
+int terminal_wait(int timeout);
+
+/**
+ * @brief	This routine waits until input is available
+ * 			or the timeout (in milliseconds) expires.
+ *
+ * @return	1 if input is available, 0 otherwise
+ */
+int terminal_wait_input(int timeout);
+
 #endif // __TERMINAL_H_
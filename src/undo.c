@@ -0,0 +1,502 @@
+/**
+ * @file:		src/undo.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the undo history. Edits are recorded
+ * 				as operations on rows, with their text kept in large
+ * 				blocks. Consecutive keystrokes and the rows of a paste
+ * 				are merged into single operations.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "document.h"
+#include "editor.h"
+#include "roku.h"
+#include "undo.h"
+
+// the operations below top can be undone, the rest can be redone
+static struct {
+	undo_op_t *ops;
+	int count;
+	int top;
+	int capacity;
+	// number of operations dropped from the front of the history
+	long base;
+	undo_chunk_t *chunks;
+	undo_chunk_t *last;
+	size_t memory;
+	unsigned int group;
+	int group_ops;
+	// the last operation may not be extended any more
+	int sealed;
+	// the next operation on text is a typed character
+	int typed;
+	int paused;
+	// position of the history the file was saved at, -1 if it is gone
+	long saved;
+} history;
+
+/**
+ * @brief	This routine starts a new change. Operations recorded until
+ * 			the next call are undone together.
+ */
+void undo_break()
+{
+	history.group++;
+	history.group_ops = 0;
+}
+
+/**
+ * @brief	This routine keeps the next operation from being merged
+ * 			into the last one, after the cursor moved for instance.
+ */
+void undo_seal()
+{
+	history.sealed = 1;
+}
+
+/**
+ * @brief	This routine marks the next operation on text as a typed
+ * 			or deleted character, which may be merged with the ones
+ * 			before. Text changed in any other way is recorded on its own.
+ */
+void undo_typed()
+{
+	history.typed = 1;
+}
+
+/**
+ * @brief	This routine stops recording operations.
+ */
+void undo_pause()
+{
+	history.paused++;
+}
+
+/**
+ * @brief	This routine resumes recording operations.
+ */
+void undo_resume()
+{
+	history.paused--;
+}
+
+/**
+ * @brief	This routine hands out memory for the text of an operation.
+ */
+static char *undo_alloc(size_t len, long op)
+{
+	undo_chunk_t *chunk = history.last;
+
+	if (chunk == NULL || chunk->size - chunk->used < len) {
+		size_t size = len > UNDO_CHUNK ? len : UNDO_CHUNK;
+		chunk = malloc(sizeof(undo_chunk_t) + size);
+		chunk->next = NULL;
+		chunk->size = size;
+		chunk->used = 0;
+		chunk->first_op = op;
+
+		if (history.last) {
+			history.last->next = chunk;
+		} else {
+			history.chunks = chunk;
+		}
+		history.last = chunk;
+		history.memory += size;
+	}
+
+	chunk->last_op = op;
+	char *text = chunk->data + chunk->used;
+	chunk->used += len;
+	return text;
+}
+
+/**
+ * @brief	This routine forgets the changes that could be redone.
+ */
+static void undo_drop_redo()
+{
+	if (history.top == history.count) {
+		return;
+	}
+
+	// blocks are in the order of the operations using them
+	long cut = history.base + history.top;
+	undo_chunk_t **link = &history.chunks;
+	history.last = NULL;
+	while (*link && (*link)->first_op < cut) {
+		history.last = *link;
+		link = &(*link)->next;
+	}
+
+	undo_chunk_t *chunk = *link;
+	*link = NULL;
+	while (chunk) {
+		undo_chunk_t *next = chunk->next;
+		history.memory -= chunk->size;
+		free(chunk);
+		chunk = next;
+	}
+
+	history.count = history.top;
+	if (history.saved > history.base + history.count) {
+		history.saved = -1;
+	}
+}
+
+/**
+ * @brief	This routine drops the oldest changes once the history
+ * 			takes up too much memory. The latest change is always kept.
+ */
+static void undo_trim()
+{
+	size_t ops_size = sizeof(undo_op_t) * history.count;
+	if (history.memory + ops_size <= UNDO_MEMORY) {
+		return;
+	}
+
+	// drop a quarter at once, so this doesn't happen on every keystroke
+	size_t target = UNDO_MEMORY / 4 * 3;
+	unsigned int latest = history.ops[history.count - 1].group;
+	int drop = 0;
+
+	while (drop < history.count && history.ops[drop].group != latest &&
+		   history.memory + sizeof(undo_op_t) * (history.count - drop) >
+			   target) {
+		unsigned int group = history.ops[drop].group;
+		while (drop < history.count && history.ops[drop].group == group) {
+			drop++;
+		}
+
+		while (history.chunks != history.last &&
+			   history.chunks->last_op < history.base + drop) {
+			undo_chunk_t *chunk = history.chunks;
+			history.chunks = chunk->next;
+			history.memory -= chunk->size;
+			free(chunk);
+		}
+	}
+
+	memmove(history.ops, &history.ops[drop],
+			sizeof(undo_op_t) * (history.count - drop));
+	history.count -= drop;
+	history.top -= drop;
+	history.base += drop;
+}
+
+/**
+ * @brief	This routine tries to extend the last operation, so that
+ * 			typing, deleting and pasting don't record every keystroke
+ * 			or row on its own.
+ *
+ * @return	1 if the operation was merged, 0 otherwise
+ */
+static int undo_coalesce(int type, int y, int x, const char *s, int len,
+						 int typed)
+{
+	if (history.count == 0 || history.sealed) {
+		return 0;
+	}
+
+	undo_op_t *op = &history.ops[history.count - 1];
+	undo_chunk_t *chunk = history.last;
+	int sep = type == UNDO_INSERT_ROWS || type == UNDO_REMOVE_ROWS;
+
+	// the text has to go right behind the text of the operation
+	if (op->type != type || chunk == NULL ||
+		op->text + op->len != chunk->data + chunk->used ||
+		chunk->size - chunk->used < (size_t)len + sep) {
+		return 0;
+	}
+
+	int typing = typed && history.group_ops == 0 && len == 1 && op->y == y;
+	switch (type) {
+	case UNDO_INSERT_TEXT:
+		if (!typing || op->x + op->len != x) {
+			return 0;
+		}
+		break;
+	case UNDO_REMOVE_TEXT:
+		if (typing && x == op->x - 1 && (op->reversed || op->len == 1)) {
+			op->reversed = 1;
+			op->x = x;
+		} else if (!typing || x != op->x || op->reversed) {
+			return 0;
+		}
+		break;
+	case UNDO_INSERT_ROWS:
+		if (op->group != history.group || y != op->y + op->rows) {
+			return 0;
+		}
+		break;
+	case UNDO_REMOVE_ROWS:
+		if (op->group != history.group || y != op->y) {
+			return 0;
+		}
+		break;
+	}
+
+	// the rest of the keystroke belongs to the same change
+	history.group = op->group;
+
+	char *text = undo_alloc(len + sep, history.base + history.count - 1);
+	if (sep) {
+		*text++ = '\n';
+		op->rows++;
+	}
+	memcpy(text, s, len);
+	op->len += len + sep;
+	return 1;
+}
+
+/**
+ * @brief	This routine adds an operation to the history.
+ */
+static void undo_record(int type, int y, int x, const char *s, int len)
+{
+	int typed = history.typed;
+	history.typed = 0;
+	if (history.paused) {
+		return;
+	}
+
+	undo_drop_redo();
+	if (undo_coalesce(type, y, x, s, len, typed)) {
+		return;
+	}
+
+	if (history.count == history.capacity) {
+		history.capacity = history.capacity ? history.capacity * 2 : 256;
+		history.ops =
+			realloc(history.ops, sizeof(undo_op_t) * history.capacity);
+	}
+
+	undo_op_t *op = &history.ops[history.count];
+	op->type = type;
+	op->reversed = 0;
+	op->group = history.group;
+	op->y = y;
+	op->x = x;
+	op->len = len;
+	op->rows = 1;
+	op->text = undo_alloc(len, history.base + history.count);
+	memcpy(op->text, s, len);
+
+	history.count++;
+	history.top = history.count;
+	history.group_ops++;
+	// text changed other than by typing isn't extended by typing either
+	history.sealed = !typed && (type == UNDO_INSERT_TEXT ||
+								type == UNDO_REMOVE_TEXT);
+	undo_trim();
+}
+
+/**
+ * @brief	This routine records the insertion of text into a row.
+ */
+void undo_insert_text(editor_row_t *row, int at, const char *s, int len)
+{
+	if (!history.paused) {
+		undo_record(UNDO_INSERT_TEXT, document_row_index(row), at, s, len);
+	}
+}
+
+/**
+ * @brief	This routine records the removal of text from a row,
+ * 			before it is removed.
+ */
+void undo_remove_text(editor_row_t *row, int at, const char *s, int len)
+{
+	if (!history.paused) {
+		undo_record(UNDO_REMOVE_TEXT, document_row_index(row), at, s, len);
+	}
+}
+
+/**
+ * @brief	This routine records the insertion of a row.
+ */
+void undo_insert_row(int at, const char *s, int len)
+{
+	undo_record(UNDO_INSERT_ROWS, at, 0, s, len);
+}
+
+/**
+ * @brief	This routine records the removal of a row,
+ * 			before it is removed.
+ */
+void undo_remove_row(int at, const char *s, int len)
+{
+	undo_record(UNDO_REMOVE_ROWS, at, 0, s, len);
+}
+
+/**
+ * @brief	This routine applies an operation, or reverts it.
+ * 			The cursor is moved to the changed text.
+ *
+ * @return	1 if the operation changed text inside of a row
+ */
+static int undo_apply(const undo_op_t *op, int revert)
+{
+	int insert = (op->type == UNDO_INSERT_TEXT ||
+				  op->type == UNDO_INSERT_ROWS) != revert;
+
+	if (op->type == UNDO_INSERT_TEXT || op->type == UNDO_REMOVE_TEXT) {
+		editor_row_t *row = editor_get_row(op->y);
+		roku_config.cur_y = op->y;
+		roku_config.cur_x = op->x;
+
+		if (!insert) {
+			editor_row_delete(row, op->x, op->len);
+		} else if (op->reversed) {
+			char *text = malloc(op->len);
+			for (int i = 0; i < op->len; i++) {
+				text[i] = op->text[op->len - 1 - i];
+			}
+			editor_row_insert(row, op->x, text, op->len);
+			free(text);
+		} else {
+			editor_row_insert(row, op->x, op->text, op->len);
+		}
+
+		// text deleted in front of the cursor leaves it in place
+		if (insert && (op->type == UNDO_INSERT_TEXT || op->reversed)) {
+			roku_config.cur_x += op->len;
+		}
+		return 1;
+	}
+
+	roku_config.cur_y = op->y;
+	roku_config.cur_x = 0;
+
+	if (insert) {
+		const char *s = op->text;
+		const char *end = op->text + op->len;
+		for (int i = 0; i < op->rows; i++) {
+			const char *newline = memchr(s, '\n', end - s);
+			if (newline == NULL) {
+				newline = end;
+			}
+			editor_append_row(op->y + i, s, newline - s);
+			s = newline + 1;
+		}
+	} else {
+		for (int i = 0; i < op->rows; i++) {
+			editor_remove_row(op->y);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	This routine keeps the cursor inside of the document.
+ */
+static void undo_clamp_cursor(int cur_x, int cur_y)
+{
+	roku_config.cur_x = cur_x;
+	roku_config.cur_y = cur_y;
+
+	if (roku_config.cur_y > roku_config.num_rows) {
+		roku_config.cur_y = roku_config.num_rows;
+	}
+	if (roku_config.cur_y == roku_config.num_rows) {
+		roku_config.cur_x = 0;
+	} else if (roku_config.cur_x > editor_get_row(roku_config.cur_y)->size) {
+		roku_config.cur_x = editor_get_row(roku_config.cur_y)->size;
+	}
+}
+
+/**
+ * @brief	This routine checks whether the text is the same
+ * 			as when the file was saved.
+ */
+static void undo_update_dirty()
+{
+	roku_config.file_dirty = history.base + history.top != history.saved;
+}
+
+/**
+ * @brief	This routine returns the current position of the history.
+ * 			The last operation is sealed, so that the text at this
+ * 			position isn't changed by merging later edits into it.
+ */
+long undo_position()
+{
+	history.sealed = 1;
+	return history.base + history.top;
+}
+
+/**
+ * @brief	This routine takes note of the file having been saved
+ * 			with the text at the specified position of the history.
+ */
+void undo_saved(long position)
+{
+	history.saved = position;
+	undo_update_dirty();
+}
+
+/**
+ * @brief	This routine reverts the last change.
+ */
+void undo()
+{
+	if (history.top == 0) {
+		editor_set_status("Nothing to undo");
+		return;
+	}
+
+	// a change inside of a row places the cursor better than rows do
+	int cur_x = 0, cur_y = 0, in_row = 0;
+	unsigned int group = history.ops[history.top - 1].group;
+
+	undo_pause();
+	while (history.top > 0 && history.ops[history.top - 1].group == group) {
+		history.top--;
+		int changed_row = undo_apply(&history.ops[history.top], 1);
+		if (changed_row || !in_row) {
+			cur_x = roku_config.cur_x;
+			cur_y = roku_config.cur_y;
+		}
+		in_row |= changed_row;
+	}
+	undo_resume();
+
+	undo_clamp_cursor(cur_x, cur_y);
+	undo_update_dirty();
+	history.sealed = 1;
+}
+
+/**
+ * @brief	This routine applies the last reverted change again.
+ */
+void redo()
+{
+	if (history.top == history.count) {
+		editor_set_status("Nothing to redo");
+		return;
+	}
+
+	int cur_x = 0, cur_y = 0, in_row = 0;
+	unsigned int group = history.ops[history.top].group;
+
+	undo_pause();
+	while (history.top < history.count &&
+		   history.ops[history.top].group == group) {
+		int changed_row = undo_apply(&history.ops[history.top], 0);
+		if (changed_row || !in_row) {
+			cur_x = roku_config.cur_x;
+			cur_y = roku_config.cur_y;
+		}
+		in_row |= changed_row;
+		history.top++;
+	}
+	undo_resume();
+
+	undo_clamp_cursor(cur_x, cur_y);
+	undo_update_dirty();
+	history.sealed = 1;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file:		src/undo.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the undo history.
+ */
+
+#ifndef __UNDO_H_
+#define __UNDO_H_
+
+#include <stddef.h>
+
+#include "roku.h"
+
+// size of the blocks the text of the operations is stored in
+#define UNDO_CHUNK (64 << 10)
+
+/**
+ * @brief	This enum contains the kinds of operations in the history.
+ */
+enum undo_type {
+	UNDO_INSERT_TEXT = 0,
+	UNDO_REMOVE_TEXT,
+	UNDO_INSERT_ROWS,
+	UNDO_REMOVE_ROWS
+};
+
+/**
+ * @brief	This structure is an operation in the history. Text
+ * 			operations cover len bytes at column x of row y, row
+ * 			operations cover rows rows starting at row y, their text
+ * 			is separated by newlines.
+ */
+typedef struct {
+	unsigned char type;
+	// text removed by a run of backspaces is stored back to front
+	unsigned char reversed;
+	unsigned int group;
+	int y, x;
+	int len;
+	int rows;
+	char *text;
+} undo_op_t;
+
+/**
+ * @brief	This structure is a block of memory holding the text
+ * 			of operations, handed out front to back.
+ */
+typedef struct undo_chunk {
+	struct undo_chunk *next;
+	size_t size;
+	size_t used;
+	// operations whose text is in the block
+	long first_op;
+	long last_op;
+	char data[];
+} undo_chunk_t;
+
+/**
+ * @brief	This routine starts a new change. Operations recorded until
+ * 			the next call are undone together.
+ */
+void undo_break();
+
+/**
+ * @brief	This routine keeps the next operation from being merged
+ * 			into the last one, after the cursor moved for instance.
+ */
+void undo_seal();
+
+/**
+ * @brief	This routine marks the next operation on text as a typed
+ * 			or deleted character, which may be merged with the ones
+ * 			before. Text changed in any other way is recorded on its own.
+ */
+void undo_typed();
+
+/**
+ * @brief	This routine stops recording operations.
+ */
+void undo_pause();
+
+/**
+ * @brief	This routine resumes recording operations.
+ */
+void undo_resume();
+
+/**
+ * @brief	This routine records the insertion of text into a row.
+ */
+void undo_insert_text(editor_row_t *row, int at, const char *s, int len);
+
+/**
+ * @brief	This routine records the removal of text from a row,
+ * 			before it is removed.
+ */
+void undo_remove_text(editor_row_t *row, int at, const char *s, int len);
+
+/**
+ * @brief	This routine records the insertion of a row.
+ */
+void undo_insert_row(int at, const char *s, int len);
+
+/**
+ * @brief	This routine records the removal of a row,
+ * 			before it is removed.
+ */
+void undo_remove_row(int at, const char *s, int len);
+
+/**
+ * @brief	This routine returns the current position of the history.
+ * 			The last operation is sealed, so that the text at this
+ * 			position isn't changed by merging later edits into it.
+ */
+long undo_position();
+
+/**
+ * @brief	This routine takes note of the file having been saved
+ * 			with the text at the specified position of the history.
+ */
+void undo_saved(long position);
+
+/**
+ * @brief	This routine reverts the last change.
+ */
+void undo();
+
+/**
+ * @brief	This routine applies the last reverted change again.
+ */
+void redo();
+
+#endif // __UNDO_H_
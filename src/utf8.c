@@ -0,0 +1,205 @@
+/**
+ * @file:		src/utf8.c
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the routines to decode UTF-8
+ * 				and to tell how many columns a character takes up.
+ * 				Widths are looked up in tables of ranges, rows of
+ * 				plain ASCII are recognized 16 bytes at a time.
+ */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utf8.h"
+
+/**
+ * @brief	This structure is a range of code points.
+ */
+typedef struct {
+	int first;
+	int last;
+} utf8_range_t;
+
+// combining marks and other characters that take up no column
+static const utf8_range_t utf8_zero[] = {
+	{ 0x0300, 0x036f },	  { 0x0483, 0x0489 },	{ 0x0591, 0x05bd },
+	{ 0x05bf, 0x05bf },	  { 0x05c1, 0x05c2 },	{ 0x05c4, 0x05c5 },
+	{ 0x05c7, 0x05c7 },	  { 0x0610, 0x061a },	{ 0x064b, 0x065f },
+	{ 0x0670, 0x0670 },	  { 0x06d6, 0x06dc },	{ 0x06df, 0x06e4 },
+	{ 0x06e7, 0x06e8 },	  { 0x06ea, 0x06ed },	{ 0x0900, 0x0902 },
+	{ 0x093a, 0x093a },	  { 0x093c, 0x093c },	{ 0x0941, 0x0948 },
+	{ 0x094d, 0x094d },	  { 0x0951, 0x0957 },	{ 0x0e31, 0x0e31 },
+	{ 0x0e34, 0x0e3a },	  { 0x0e47, 0x0e4e },	{ 0x1ab0, 0x1aff },
+	{ 0x1dc0, 0x1dff },	  { 0x200b, 0x200f },	{ 0x202a, 0x202e },
+	{ 0x2060, 0x2064 },	  { 0x20d0, 0x20ff },	{ 0x302a, 0x302d },
+	{ 0x3099, 0x309a },	  { 0xfe00, 0xfe0f },	{ 0xfe20, 0xfe2f },
+	{ 0xfeff, 0xfeff },	  { 0xe0100, 0xe01ef },
+};
+
+// East Asian wide and fullwidth characters, and emoji
+static const utf8_range_t utf8_wide[] = {
+	{ 0x1100, 0x115f },	  { 0x231a, 0x231b },	{ 0x2329, 0x232a },
+	{ 0x23e9, 0x23ec },	  { 0x23f0, 0x23f0 },	{ 0x23f3, 0x23f3 },
+	{ 0x25fd, 0x25fe },	  { 0x2614, 0x2615 },	{ 0x2648, 0x2653 },
+	{ 0x267f, 0x267f },	  { 0x2693, 0x2693 },	{ 0x26a1, 0x26a1 },
+	{ 0x26aa, 0x26ab },	  { 0x26bd, 0x26be },	{ 0x26c4, 0x26c5 },
+	{ 0x26ce, 0x26ce },	  { 0x26d4, 0x26d4 },	{ 0x26ea, 0x26ea },
+	{ 0x26f2, 0x26f3 },	  { 0x26f5, 0x26f5 },	{ 0x26fa, 0x26fa },
+	{ 0x26fd, 0x26fd },	  { 0x2705, 0x2705 },	{ 0x270a, 0x270b },
+	{ 0x2728, 0x2728 },	  { 0x274c, 0x274c },	{ 0x274e, 0x274e },
+	{ 0x2753, 0x2755 },	  { 0x2757, 0x2757 },	{ 0x2795, 0x2797 },
+	{ 0x27b0, 0x27b0 },	  { 0x27bf, 0x27bf },	{ 0x2b1b, 0x2b1c },
+	{ 0x2b50, 0x2b50 },	  { 0x2b55, 0x2b55 },	{ 0x2e80, 0x303e },
+	{ 0x3041, 0x3247 },	  { 0x3250, 0x4dbf },	{ 0x4e00, 0xa4c6 },
+	{ 0xa960, 0xa97c },	  { 0xac00, 0xd7a3 },	{ 0xf900, 0xfaff },
+	{ 0xfe10, 0xfe19 },	  { 0xfe30, 0xfe6b },	{ 0xff01, 0xff60 },
+	{ 0xffe0, 0xffe6 },	  { 0x16fe0, 0x16fe4 }, { 0x17000, 0x18cd5 },
+	{ 0x1b000, 0x1b2fb }, { 0x1f004, 0x1f004 }, { 0x1f0cf, 0x1f0cf },
+	{ 0x1f18e, 0x1f18e }, { 0x1f191, 0x1f19a }, { 0x1f200, 0x1f251 },
+	{ 0x1f300, 0x1f320 }, { 0x1f32d, 0x1f335 }, { 0x1f337, 0x1f37c },
+	{ 0x1f37e, 0x1f393 }, { 0x1f3a0, 0x1f3ca }, { 0x1f3cf, 0x1f3d3 },
+	{ 0x1f3e0, 0x1f3f0 }, { 0x1f3f4, 0x1f3f4 }, { 0x1f3f8, 0x1f43e },
+	{ 0x1f440, 0x1f440 }, { 0x1f442, 0x1f4fc }, { 0x1f4ff, 0x1f53d },
+	{ 0x1f54b, 0x1f54e }, { 0x1f550, 0x1f567 }, { 0x1f57a, 0x1f57a },
+	{ 0x1f595, 0x1f596 }, { 0x1f5a4, 0x1f5a4 }, { 0x1f5fb, 0x1f64f },
+	{ 0x1f680, 0x1f6c5 }, { 0x1f6cc, 0x1f6cc }, { 0x1f6d0, 0x1f6d2 },
+	{ 0x1f6d5, 0x1f6d7 }, { 0x1f6eb, 0x1f6ec }, { 0x1f6f4, 0x1f6fc },
+	{ 0x1f7e0, 0x1f7eb }, { 0x1f90c, 0x1f93a }, { 0x1f93c, 0x1f945 },
+	{ 0x1f947, 0x1f9ff }, { 0x1fa70, 0x1faff }, { 0x20000, 0x2fffd },
+	{ 0x30000, 0x3fffd },
+};
+
+#define UTF8_RANGES(table) (int)(sizeof(table) / sizeof(table[0]))
+
+/**
+ * @brief	This routine decodes the character at the start of a string.
+ * 			Bytes that aren't valid UTF-8 are decoded one at a time
+ * 			as -1.
+ *
+ * @return	Length of the character in bytes
+ */
+int utf8_decode(const char *s, int len, int *cp)
+{
+	const unsigned char *u = (const unsigned char *)s;
+
+	if (u[0] < 0x80) {
+		*cp = u[0];
+		return 1;
+	}
+
+	int n;
+	int min;
+	if (u[0] >= 0xc2 && u[0] <= 0xdf) {
+		n = 2;
+		min = 0x80;
+		*cp = u[0] & 0x1f;
+	} else if (u[0] >= 0xe0 && u[0] <= 0xef) {
+		n = 3;
+		min = 0x800;
+		*cp = u[0] & 0x0f;
+	} else if (u[0] >= 0xf0 && u[0] <= 0xf4) {
+		n = 4;
+		min = 0x10000;
+		*cp = u[0] & 0x07;
+	} else {
+		*cp = -1;
+		return 1;
+	}
+
+	if (len < n) {
+		*cp = -1;
+		return 1;
+	}
+	for (int i = 1; i < n; i++) {
+		if (!UTF8_IS_CONT(u[i])) {
+			*cp = -1;
+			return 1;
+		}
+		*cp = (*cp << 6) | (u[i] & 0x3f);
+	}
+
+	// overlong forms, surrogates and anything past the last plane
+	if (*cp < min || (*cp >= 0xd800 && *cp <= 0xdfff) || *cp > 0x10ffff) {
+		*cp = -1;
+		return 1;
+	}
+
+	return n;
+}
+
+/**
+ * @brief	This routine looks for a code point in a table of ranges.
+ */
+static int utf8_in_table(const utf8_range_t *table, int count, int cp)
+{
+	int lo = 0, hi = count - 1;
+
+	if (cp < table[0].first || cp > table[hi].last) {
+		return 0;
+	}
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (cp > table[mid].last) {
+			lo = mid + 1;
+		} else if (cp < table[mid].first) {
+			hi = mid - 1;
+		} else {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	This routine returns the number of columns a character
+ * 			takes up on the terminal: 0 for combining characters,
+ * 			2 for wide ones and 1 for everything else.
+ */
+int utf8_width(int cp)
+{
+	// nothing below the first combining mark is wide or invisible
+	if (cp < 0x300) {
+		return 1;
+	}
+	if (utf8_in_table(utf8_zero, UTF8_RANGES(utf8_zero), cp)) {
+		return 0;
+	}
+	if (utf8_in_table(utf8_wide, UTF8_RANGES(utf8_wide), cp)) {
+		return 2;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief	This routine checks whether a string is plain ASCII
+ * 			without tabs, so every byte takes up a single column.
+ */
+int utf8_is_plain(const char *s, int len)
+{
+	int i = 0;
+
+#ifdef __SSE2__
+	const __m128i tab = _mm_set1_epi8('\t');
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		// bytes with the top bit set belong to multi-byte characters
+		if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, tab)))) {
+			return 0;
+		}
+	}
+#endif
+
+	for (; i < len; i++) {
+		if ((unsigned char)s[i] >= 0x80 || s[i] == '\t') {
+			return 0;
+		}
+	}
+
+	return 1;
+}
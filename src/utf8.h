@@ -0,0 +1,42 @@
+/**
+ * @file:		src/utf8.h
+ * @author:		Jozef Nagy <schkwve@gmail.com>
+ * @copyright:	MIT (See LICENSE.md)
+ * @brief:		This file contains the routines to decode UTF-8
+ * 				and to tell how many columns a character takes up.
+ */
+
+#ifndef __UTF8_H_
+#define __UTF8_H_
+
+// character shown in place of bytes that aren't valid UTF-8
+#define UTF8_INVALID '?'
+
+/**
+ * @brief	Checks whether a byte continues a multi-byte sequence.
+ */
+#define UTF8_IS_CONT(c) (((unsigned char)(c) & 0xc0) == 0x80)
+
+/**
+ * @brief	This routine decodes the character at the start of a string.
+ * 			Bytes that aren't valid UTF-8 are decoded one at a time
+ * 			as -1.
+ *
+ * @return	Length of the character in bytes
+ */
+int utf8_decode(const char *s, int len, int *cp);
+
+/**
+ * @brief	This routine returns the number of columns a character
+ * 			takes up on the terminal: 0 for combining characters,
+ * 			2 for wide ones and 1 for everything else.
+ */
+int utf8_width(int cp);
+
+/**
+ * @brief	This routine checks whether a string is plain ASCII
+ * 			without tabs, so every byte takes up a single column.
+ */
+int utf8_is_plain(const char *s, int len);
+
+#endif // __UTF8_H_